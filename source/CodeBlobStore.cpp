@@ -0,0 +1,221 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#include <cstring>
+
+#include "CodeBlobStore.h"
+#include "SpirvCompression.h"
+
+namespace
+{
+/// Distinguishes blob entries from kernel entries in the shader cache ('BLOB').
+const uint32_t kBlobTag = 0x424f4c42;
+
+Hash128 computeBlobKey(const Hash128& hash)
+{
+    Hasher hasher;
+    hasher.update(kBlobTag);
+    hasher.update(hash);
+    return hasher.getDigest();
+}
+} // namespace
+
+void CodeBlobStore::setDiskCache(ShaderCache* pDiskCache)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mpDiskCache = pDiskCache;
+}
+
+std::shared_ptr<const CodeBlob> CodeBlobStore::find(const Hash128& hash)
+{
+    auto it = mBlobs.find(hash);
+    if (it == mBlobs.end())
+        return nullptr;
+    return it->second.lock();
+}
+
+std::shared_ptr<const CodeBlob> CodeBlobStore::findOrInsert(const Hash128& hash, const void* data, size_t size)
+{
+    mStats.addCount++;
+    mStats.addedBytes += size;
+
+    auto& pWeakBlob = mBlobs[hash];
+    if (auto pBlob = pWeakBlob.lock())
+    {
+        if (pBlob->data.size() == size && std::memcmp(pBlob->data.data(), data, size) == 0)
+            return pBlob;
+    }
+
+    auto pBlob = std::make_shared<CodeBlob>();
+    pBlob->hash = hash;
+    pBlob->data.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+    pWeakBlob = pBlob;
+    mStats.uniqueAddCount++;
+    mStats.uniqueBytes += size;
+    return pBlob;
+}
+
+std::shared_ptr<const CodeBlob> CodeBlobStore::add(const void* data, size_t size)
+{
+    Hash128 hash = hash128(data, size);
+    std::lock_guard<std::mutex> lock(mMutex);
+    return findOrInsert(hash, data, size);
+}
+
+std::shared_ptr<const CodeBlob> CodeBlobStore::storeKernel(const Hash128& kernelKey, const void* data, size_t size)
+{
+    Hash128 hash = hash128(data, size);
+    std::shared_ptr<const CodeBlob> pBlob;
+    ShaderCache* pDiskCache;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        pBlob = findOrInsert(hash, data, size);
+        pDiskCache = mpDiskCache;
+    }
+    if (!pDiskCache)
+        return pBlob;
+
+    // Compression and disk I/O don't hold the lock, so kernels of different threads are stored in parallel.
+    Hash128 blobKey = computeBlobKey(hash);
+    if (pDiskCache->contains(blobKey))
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.diskBlobsShared++;
+    }
+    else
+    {
+        std::vector<uint8_t> compressed;
+        const bool isCompressed = compressSpirv(pBlob->data.data(), pBlob->data.size(), compressed);
+        const std::vector<uint8_t>& stored = isCompressed ? compressed : pBlob->data;
+        if (pDiskCache->store(blobKey, stored.data(), stored.size()))
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStats.diskBlobsWritten++;
+            mStats.diskBlobBytes += pBlob->data.size();
+            mStats.diskBlobStoredBytes += stored.size();
+        }
+    }
+    pDiskCache->store(kernelKey, &hash, sizeof(hash));
+    return pBlob;
+}
+
+std::shared_ptr<const CodeBlob> CodeBlobStore::loadKernel(const Hash128& kernelKey)
+{
+    ShaderCache* pDiskCache;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        pDiskCache = mpDiskCache;
+    }
+    if (!pDiskCache)
+        return nullptr;
+
+    std::vector<uint8_t> data;
+    if (!pDiskCache->load(kernelKey, data) || data.size() != sizeof(Hash128))
+        return nullptr;
+    Hash128 hash;
+    std::memcpy(&hash, data.data(), sizeof(hash));
+
+    // Kernels with identical code share the blob that is already in memory.
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (auto pBlob = find(hash))
+        {
+            mStats.addCount++;
+            mStats.addedBytes += pBlob->data.size();
+            return pBlob;
+        }
+    }
+
+    if (!pDiskCache->load(computeBlobKey(hash), data))
+        return nullptr;
+    if (isCompressedSpirv(data.data(), data.size()))
+    {
+        std::vector<uint8_t> compressed = std::move(data);
+        if (!decompressSpirv(compressed.data(), compressed.size(), data))
+            return nullptr;
+    }
+    if (hash128(data.data(), data.size()) != hash)
+        return nullptr;
+
+    // Another thread may have loaded the same blob meanwhile, findOrInsert() returns its copy then.
+    std::lock_guard<std::mutex> lock(mMutex);
+    return findOrInsert(hash, data.data(), data.size());
+}
+
+bool CodeBlobStore::containsKernel(const Hash128& kernelKey)
+{
+    ShaderCache* pDiskCache;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        pDiskCache = mpDiskCache;
+    }
+    return pDiskCache && pDiskCache->contains(kernelKey);
+}
+
+ShaderCache::EntryLock CodeBlobStore::lockKernel(const Hash128& kernelKey)
+{
+    ShaderCache* pDiskCache;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        pDiskCache = mpDiskCache;
+    }
+    if (!pDiskCache)
+        return {};
+
+    // Don't block other threads using the store while waiting for the lock.
+    ShaderCache::EntryLock entryLock = pDiskCache->lockEntry(kernelKey);
+    if (entryLock.hasWaited())
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.diskLockWaits++;
+    }
+    return entryLock;
+}
+
+void CodeBlobStore::pruneExpired()
+{
+    for (auto it = mBlobs.begin(); it != mBlobs.end();)
+    {
+        if (it->second.expired())
+            it = mBlobs.erase(it);
+        else
+            ++it;
+    }
+}
+
+CodeBlobStore::Stats CodeBlobStore::getStats()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    pruneExpired();
+
+    Stats stats = mStats;
+    stats.liveBlobCount = 0;
+    stats.liveBytes = 0;
+    stats.referencedBytes = 0;
+    for (const auto& entry : mBlobs)
+    {
+        if (auto pBlob = entry.second.lock())
+        {
+            // Don't count the reference held by this loop.
+            uint64_t size = pBlob->data.size();
+            stats.liveBlobCount++;
+            stats.liveBytes += size;
+            stats.referencedBytes += size * uint64_t(pBlob.use_count() - 1);
+        }
+    }
+    return stats;
+}
+
+ShaderCache::Stats CodeBlobStore::getDiskCacheStats()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mpDiskCache ? mpDiskCache->getStats() : ShaderCache::Stats();
+}
+
+void CodeBlobStore::resetStats()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStats = {};
+    if (mpDiskCache)
+        mpDiskCache->resetStats();
+}
@@ -0,0 +1,118 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Hash.h"
+#include "ShaderCache.h"
+
+/**
+ * Kernel code, identified by the hash of its contents.
+ */
+struct CodeBlob
+{
+    Hash128 hash;              ///< Hash of the code.
+    std::vector<uint8_t> data; ///< The code.
+};
+
+/**
+ * Content-addressed store for kernel code.
+ *
+ * Permutations of a program often differ only in macros that don't affect a given entry
+ * point, and then produce identical code. The store keeps a single copy of each distinct
+ * blob in memory, shared by all kernels that reference it. Blobs are reference counted and
+ * released when the last kernel referencing them is destroyed.
+ *
+ * If a shader cache is attached, blobs are also stored in the cache under their content
+ * hash. Kernel cache entries only hold the content hash of their code, so identical code of
+ * different kernels is stored once on disk as well. SPIR-V blobs are compressed with
+ * `compressSpirv()` on disk and decompressed when loaded.
+ */
+class CodeBlobStore
+{
+public:
+    struct Stats
+    {
+        size_t addCount = 0;         ///< Number of blobs added or loaded, including duplicates.
+        size_t uniqueAddCount = 0;   ///< Number of blobs that were not in memory already.
+        uint64_t addedBytes = 0;     ///< Bytes of all blobs added or loaded.
+        uint64_t uniqueBytes = 0;    ///< Bytes of the blobs that were not in memory already.
+        size_t diskBlobsWritten = 0; ///< Blobs written to the shader cache.
+        size_t diskBlobsShared = 0;  ///< Kernel entries that reference a blob already in the shader cache.
+        size_t diskLockWaits = 0;    ///< Kernels whose code was being generated by another thread or process when requested.
+        uint64_t diskBlobBytes = 0;       ///< Bytes of the blobs written to the shader cache, before compression.
+        uint64_t diskBlobStoredBytes = 0; ///< Bytes of the blobs written to the shader cache, after compression.
+        size_t liveBlobCount = 0;    ///< Distinct blobs currently in memory.
+        uint64_t liveBytes = 0;      ///< Bytes of the distinct blobs currently in memory.
+        uint64_t referencedBytes = 0; ///< Bytes the blobs currently in memory would take without sharing.
+
+        /// Ratio of added to stored bytes over the lifetime of the store.
+        double getDedupRatio() const { return uniqueBytes > 0 ? double(addedBytes) / double(uniqueBytes) : 1.0; }
+    };
+
+    /**
+     * Set the shader cache blobs are persisted in. Pass nullptr to keep blobs in memory only.
+     * The shader cache is used without holding the store's lock, so it must not be changed
+     * while kernels are loaded or stored on other threads.
+     */
+    void setDiskCache(ShaderCache* pDiskCache);
+
+    /**
+     * Add code to the store.
+     * @return The shared blob with the same contents.
+     */
+    std::shared_ptr<const CodeBlob> add(const void* data, size_t size);
+
+    /**
+     * Add the code of a kernel to the store and record it in the shader cache under the kernel's cache key.
+     */
+    std::shared_ptr<const CodeBlob> storeKernel(const Hash128& kernelKey, const void* data, size_t size);
+
+    /**
+     * Load the code of a kernel from the shader cache.
+     * @return The shared blob, or nullptr if there is no valid entry for the kernel.
+     */
+    std::shared_ptr<const CodeBlob> loadKernel(const Hash128& kernelKey);
+
+    /**
+     * Check if the shader cache has an entry for a kernel.
+     */
+    bool containsKernel(const Hash128& kernelKey);
+
+    /**
+     * Lock the shader cache entry of a kernel before generating its code, so that other
+     * processes sharing the cache wait for the code instead of generating it too.
+     * @return The lock, which is not locked if there is no shader cache.
+     */
+    ShaderCache::EntryLock lockKernel(const Hash128& kernelKey);
+
+    /**
+     * Get statistics. The live counts are computed from the blobs currently in memory.
+     */
+    Stats getStats();
+
+    /**
+     * Get the statistics of the attached shader cache.
+     */
+    ShaderCache::Stats getDiskCacheStats();
+
+    /**
+     * Reset the statistics of the store and of the attached shader cache.
+     */
+    void resetStats();
+
+private:
+    std::shared_ptr<const CodeBlob> findOrInsert(const Hash128& hash, const void* data, size_t size);
+    std::shared_ptr<const CodeBlob> find(const Hash128& hash);
+    void pruneExpired();
+
+    std::mutex mMutex; ///< Guards the blobs, the statistics and the shader cache pointer, but not disk I/O.
+    ShaderCache* mpDiskCache = nullptr;
+    std::unordered_map<Hash128, std::weak_ptr<const CodeBlob>, Hash128::HashFunction> mBlobs;
+    Stats mStats;
+};
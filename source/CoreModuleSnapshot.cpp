@@ -0,0 +1,115 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "CoreModuleSnapshot.h"
+#include "Hash.h"
+
+namespace
+{
+/// Identifies core module snapshot files ('FCMS').
+const uint32_t kSnapshotMagic = 0x534d4346;
+/// Bump when the snapshot layout changes.
+const uint32_t kSnapshotVersion = 1;
+/// Upper bound for the Slang build tag, which is a short version string.
+const uint64_t kMaxBuildTagSize = 4096;
+
+/// The header is followed by the Slang build tag and the serialized core module.
+struct SnapshotHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t buildTagSize;
+    uint64_t payloadSize;
+    Hash128 checksum; ///< Hash of the serialized core module.
+};
+} // namespace
+
+bool saveCoreModuleSnapshot(slang::IGlobalSession* pGlobalSession, const std::filesystem::path& path)
+{
+    Slang::ComPtr<ISlangBlob> pBlob;
+    if (SLANG_FAILED(pGlobalSession->saveCoreModule(SLANG_ARCHIVE_TYPE_RIFF_LZ4, pBlob.writeRef())))
+    {
+        printf("Warning: Failed to serialize the Slang core module\n");
+        return false;
+    }
+
+    std::string buildTag = pGlobalSession->getBuildTagString();
+    const void* pData = pBlob->getBufferPointer();
+    size_t size = pBlob->getBufferSize();
+    SnapshotHeader header = {kSnapshotMagic, kSnapshotVersion, uint64_t(buildTag.size()), uint64_t(size), hash128(pData, size)};
+
+    // Write to a temporary file so a concurrent startup never reads a partial snapshot.
+    std::filesystem::path tempPath = path;
+    tempPath += ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(buildTag.data(), buildTag.size());
+        file.write(static_cast<const char*>(pData), size);
+        file.close();
+        if (!file)
+        {
+            printf("Warning: Failed to write core module snapshot %s\n", path.string().c_str());
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec)
+    {
+        printf("Warning: Failed to write core module snapshot %s: %s\n", path.string().c_str(), ec.message().c_str());
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+Slang::ComPtr<slang::IGlobalSession> createGlobalSessionFromSnapshot(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return nullptr;
+
+    // The sizes in the header are checked against the file size before anything is allocated from them.
+    std::error_code ec;
+    const uintmax_t fileSize = std::filesystem::file_size(path, ec);
+    SnapshotHeader header;
+    if (ec || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != kSnapshotMagic ||
+        header.version != kSnapshotVersion || header.buildTagSize > kMaxBuildTagSize ||
+        fileSize < sizeof(header) + header.buildTagSize || header.payloadSize != fileSize - sizeof(header) - header.buildTagSize)
+    {
+        printf("Warning: Ignoring invalid core module snapshot %s\n", path.string().c_str());
+        return nullptr;
+    }
+
+    // The serialized core module can only be loaded by the Slang build that wrote it.
+    std::string buildTag(header.buildTagSize, '\0');
+    if (!file.read(buildTag.data(), buildTag.size()) || buildTag != spGetBuildTagString())
+    {
+        printf("Ignoring core module snapshot %s written by a different Slang build\n", path.string().c_str());
+        return nullptr;
+    }
+
+    std::vector<uint8_t> data(header.payloadSize);
+    if (!file.read(reinterpret_cast<char*>(data.data()), data.size()) || hash128(data.data(), data.size()) != header.checksum)
+    {
+        printf("Warning: Ignoring corrupt core module snapshot %s\n", path.string().c_str());
+        return nullptr;
+    }
+
+    Slang::ComPtr<slang::IGlobalSession> pGlobalSession;
+    if (SLANG_FAILED(slang_createGlobalSessionWithoutCoreModule(SLANG_API_VERSION, pGlobalSession.writeRef())) ||
+        SLANG_FAILED(pGlobalSession->loadCoreModule(data.data(), data.size())))
+    {
+        printf("Warning: Failed to load core module snapshot %s\n", path.string().c_str());
+        return nullptr;
+    }
+    return pGlobalSession;
+}
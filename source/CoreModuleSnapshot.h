@@ -0,0 +1,30 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#pragma once
+#include <filesystem>
+
+#include <slang.h>
+#include <slang-com-ptr.h>
+
+/**
+ * Snapshots of the Slang core module.
+ *
+ * Creating a Slang global session compiles the core module from source, which is a large part
+ * of the startup time. A snapshot holds the core module serialized with `saveCoreModule()`, so
+ * a global session can load it instead. Snapshots are written by the
+ * `falcor_core_module_snapshot` build target and are only compatible with the Slang build
+ * that wrote them.
+ */
+
+/**
+ * Write a snapshot of the core module of a global session.
+ * @return True if the snapshot was written.
+ */
+bool saveCoreModuleSnapshot(slang::IGlobalSession* pGlobalSession, const std::filesystem::path& path);
+
+/**
+ * Create a global session and load its core module from a snapshot.
+ * @return The global session, or nullptr if the snapshot is missing, corrupt or was written by a different Slang build.
+ */
+Slang::ComPtr<slang::IGlobalSession> createGlobalSessionFromSnapshot(const std::filesystem::path& path);
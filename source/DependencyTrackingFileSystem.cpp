@@ -0,0 +1,92 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#include "DependencyTrackingFileSystem.h"
+
+namespace
+{
+std::string normalizePath(const char* path)
+{
+    return std::filesystem::path(path).lexically_normal().generic_string();
+}
+} // namespace
+
+SlangResult DependencyTrackingFileSystem::queryInterface(SlangUUID const& uuid, void** outObject)
+{
+    if (void* ptr = castAs(uuid))
+    {
+        addRef();
+        *outObject = ptr;
+        return SLANG_OK;
+    }
+    *outObject = nullptr;
+    return SLANG_E_NO_INTERFACE;
+}
+
+uint32_t DependencyTrackingFileSystem::release()
+{
+    uint32_t count = --mRefCount;
+    if (count == 0)
+        delete this;
+    return count;
+}
+
+void* DependencyTrackingFileSystem::castAs(const SlangUUID& guid)
+{
+    if (guid == ISlangUnknown::getTypeGuid() || guid == ISlangCastable::getTypeGuid() || guid == ISlangFileSystem::getTypeGuid())
+        return static_cast<ISlangFileSystem*>(this);
+    return nullptr;
+}
+
+SlangResult DependencyTrackingFileSystem::loadFile(char const* path, ISlangBlob** outBlob)
+{
+    // Slang probes all search paths, most lookups are for files that don't exist.
+    std::error_code ec;
+    ShaderFileDependency dependency;
+    dependency.modifiedTime = int64_t(std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+    if (ec)
+        return SLANG_E_NOT_FOUND;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return SLANG_E_NOT_FOUND;
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    dependency.path = normalizePath(path);
+    dependency.size = text.size();
+    dependency.contentHash = hash128(text.data(), text.size());
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFiles[dependency.path] = dependency;
+    }
+
+    *outBlob = slang_createBlob(text.data(), text.size());
+    return SLANG_OK;
+}
+
+bool DependencyTrackingFileSystem::findFile(const std::string& path, ShaderFileDependency& dependency) const
+{
+    std::string normalizedPath = normalizePath(path.c_str());
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mFiles.find(normalizedPath);
+    if (it == mFiles.end())
+        return false;
+    dependency = it->second;
+    return true;
+}
+
+bool DependencyTrackingFileSystem::hasChangedFiles()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (auto& file : mFiles)
+    {
+        if (!isShaderFileDependencyUpToDate(file.second))
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,59 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <slang.h>
+
+#include "ShaderFileInfo.h"
+
+/**
+ * File system used by all Slang sessions created by the `ProgramManager`.
+ *
+ * Files are read from the OS file system. The state (modification time, size and content
+ * hash) of every file Slang opens is recorded at the time it is read, so that the inputs of
+ * a compile are known exactly, even if a file is modified while compiling.
+ * Sessions of several Slang global sessions can read files concurrently.
+ */
+class DependencyTrackingFileSystem final : public ISlangFileSystem
+{
+public:
+    // ISlangUnknown
+    SLANG_NO_THROW SlangResult SLANG_MCALL queryInterface(SlangUUID const& uuid, void** outObject) override;
+    SLANG_NO_THROW uint32_t SLANG_MCALL addRef() override { return ++mRefCount; }
+    SLANG_NO_THROW uint32_t SLANG_MCALL release() override;
+
+    // ISlangCastable
+    SLANG_NO_THROW void* SLANG_MCALL castAs(const SlangUUID& guid) override;
+
+    // ISlangFileSystem
+    SLANG_NO_THROW SlangResult SLANG_MCALL loadFile(char const* path, ISlangBlob** outBlob) override;
+
+    /**
+     * Look up the state of a file at the time it was read.
+     * @return False if the file was not read through this file system.
+     */
+    bool findFile(const std::string& path, ShaderFileDependency& dependency) const;
+
+    /**
+     * Check if any of the files read through this file system changed since they were read.
+     */
+    bool hasChangedFiles();
+
+    /**
+     * Forget about all files read so far.
+     */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFiles.clear();
+    }
+
+private:
+    std::atomic<uint32_t> mRefCount = 0;
+    mutable std::mutex mMutex; ///< Guards mFiles.
+    std::unordered_map<std::string, ShaderFileDependency> mFiles;
+};
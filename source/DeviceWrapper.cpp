@@ -1,17 +1,277 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+#include <vector>
 #include "DeviceWrapper.h"
+#include "CoreModuleSnapshot.h"
 
+bool PipelineCreationAPIDispatcher::initVulkan(gfx::IDevice* device)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mVulkanInitialized)
+        return mVkCreateComputePipelines != nullptr;
+    mVulkanInitialized = true;
+
+    const char* dynamicLibraryName = "Unknown";
+
+#if defined(Linux)
+    dynamicLibraryName = "libvulkan.so.1";
+    void* vulkanLibraryHandle = dlopen(dynamicLibraryName, RTLD_NOW);
+#elif defined(_WIN32)
+    dynamicLibraryName = "vulkan-1.dll";
+    HMODULE vulkanLibraryHandle = ::LoadLibraryA(dynamicLibraryName);
+#else
+#error "No OS specified"
+#endif
+
+    gfx::IDevice::InteropHandles outHandles;
+    device->getNativeDeviceHandles(&outHandles);
+
+    VkInstance instance;
+    instance = (VkInstance)outHandles.handles[0].handleValue;
+
+    VkPhysicalDevice physicalDevice;
+    physicalDevice = (VkPhysicalDevice)outHandles.handles[1].handleValue;
+
+    mVkDevice = (VkDevice)outHandles.handles[2].handleValue;
+
+    PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = nullptr;
+
+#if defined(Linux)
+    vkGetInstanceProcAddr = (PFN_vkGetInstanceProcAddr)dlsym(vulkanLibraryHandle, "vkGetInstanceProcAddr");
+#elif defined(_WIN32)
+    vkGetInstanceProcAddr = (PFN_vkGetInstanceProcAddr)::GetProcAddress(vulkanLibraryHandle, "vkGetInstanceProcAddr");
+#else
+#error "No OS specified"
+#endif
+
+    if (!vkGetInstanceProcAddr)
+    {
+        assert(!"Fail to get instance proc address");
+        return false;
+    }
+
+    PFN_vkGetDeviceProcAddr vkGetDeviceProcAddr = nullptr;
+    vkGetDeviceProcAddr = (PFN_vkGetDeviceProcAddr)vkGetInstanceProcAddr(instance, "vkGetDeviceProcAddr");
+    if (!vkGetDeviceProcAddr)
+    {
+        assert(!"Fail to get device proc address");
+        return false;
+    }
+
+    auto vkGetPhysicalDeviceProperties = (PFN_vkGetPhysicalDeviceProperties)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties");
+    if (vkGetPhysicalDeviceProperties)
+        vkGetPhysicalDeviceProperties(physicalDevice, &mPhysicalDeviceProperties);
+
+    // Pipeline creation feedback is core in Vulkan 1.3.
+    mSupportsCreationFeedback = mPhysicalDeviceProperties.apiVersion >= VK_API_VERSION_1_3;
+
+    mVkCreateComputePipelines = (PFN_vkCreateComputePipelines)vkGetDeviceProcAddr(mVkDevice, "vkCreateComputePipelines");
+    mVkCreatePipelineCache = (PFN_vkCreatePipelineCache)vkGetDeviceProcAddr(mVkDevice, "vkCreatePipelineCache");
+    mVkDestroyPipelineCache = (PFN_vkDestroyPipelineCache)vkGetDeviceProcAddr(mVkDevice, "vkDestroyPipelineCache");
+    mVkGetPipelineCacheData = (PFN_vkGetPipelineCacheData)vkGetDeviceProcAddr(mVkDevice, "vkGetPipelineCacheData");
+    if (!mVkCreateComputePipelines)
+    {
+        assert(!"Fail to vkCreateComputePipelines");
+        return false;
+    }
+
+    createPipelineCache();
+    return true;
+}
+
+void PipelineCreationAPIDispatcher::createPipelineCache()
+{
+    if (!mVkCreatePipelineCache || !mVkDestroyPipelineCache || !mVkGetPipelineCacheData)
+        return;
+
+    // Load the cache file and check that it was created by the same driver and device.
+    // Drivers are required to ignore incompatible data, but not all of them do so gracefully.
+    std::vector<char> data;
+    if (!mPipelineCachePath.empty())
+    {
+        std::ifstream file(mPipelineCachePath, std::ios::binary);
+        if (file)
+            data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    if (!data.empty())
+    {
+        VkPipelineCacheHeaderVersionOne header;
+        bool valid = data.size() >= sizeof(header);
+        if (valid)
+        {
+            std::memcpy(&header, data.data(), sizeof(header));
+            valid = header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                    header.vendorID == mPhysicalDeviceProperties.vendorID && header.deviceID == mPhysicalDeviceProperties.deviceID &&
+                    std::memcmp(header.pipelineCacheUUID, mPhysicalDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+        }
+        if (!valid)
+        {
+            printf("Pipeline cache %s was created by a different driver or device, ignoring it\n", mPipelineCachePath.string().c_str());
+            data.clear();
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData = data.empty() ? nullptr : data.data();
+    if (mVkCreatePipelineCache(mVkDevice, &createInfo, nullptr, &mPipelineCache) != VK_SUCCESS)
+    {
+        printf("Failed to create pipeline cache\n");
+        mPipelineCache = VK_NULL_HANDLE;
+        return;
+    }
+    mPipelineCacheStats.loadedFromDisk = !data.empty();
+}
+
+size_t PipelineCreationAPIDispatcher::getPipelineCacheDataSize()
+{
+    size_t size = 0;
+    if (mPipelineCache != VK_NULL_HANDLE)
+        mVkGetPipelineCacheData(mVkDevice, mPipelineCache, &size, nullptr);
+    return size;
+}
+
+void PipelineCreationAPIDispatcher::releasePipelineCache()
+{
+    if (mPipelineCache == VK_NULL_HANDLE)
+        return;
+
+    if (!mPipelineCachePath.empty())
+    {
+        size_t size = getPipelineCacheDataSize();
+        std::vector<char> data(size);
+        if (size > 0 && mVkGetPipelineCacheData(mVkDevice, mPipelineCache, &size, data.data()) == VK_SUCCESS)
+        {
+            // Write to a temporary file first so that an interrupted write doesn't leave a truncated cache behind.
+            std::error_code ec;
+            if (mPipelineCachePath.has_parent_path())
+                std::filesystem::create_directories(mPipelineCachePath.parent_path(), ec);
+            std::filesystem::path tempPath = mPipelineCachePath;
+            tempPath += ".tmp";
+            bool written;
+            {
+                std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+                file.write(data.data(), size);
+                written = bool(file);
+            }
+            if (written)
+                std::filesystem::rename(tempPath, mPipelineCachePath, ec);
+            if (!written || ec)
+                printf("Failed to save pipeline cache %s: %s\n", mPipelineCachePath.string().c_str(), ec.message().c_str());
+        }
+    }
+
+    mVkDestroyPipelineCache(mVkDevice, mPipelineCache, nullptr);
+    mPipelineCache = VK_NULL_HANDLE;
+}
+
+gfx::Result PipelineCreationAPIDispatcher::createComputePipelineState(
+    gfx::IDevice* device,
+    slang::IComponentType* program,
+    void* pipelineDesc,
+    void** outPipelineState
+)
+{
+    if (!initVulkan(device))
+        return SLANG_FAIL;
+
+    // Request creation feedback to find out if the pipeline was found in the cache. If the driver
+    // doesn't provide feedback, we fall back to checking if the cache grew.
+    VkComputePipelineCreateInfo computePipelineInfo = *static_cast<VkComputePipelineCreateInfo*>(pipelineDesc);
+    VkPipelineCreationFeedback creationFeedback = {};
+    VkPipelineCreationFeedbackCreateInfo creationFeedbackInfo = {};
+    if (mSupportsCreationFeedback)
+    {
+        creationFeedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+        creationFeedbackInfo.pNext = computePipelineInfo.pNext;
+        creationFeedbackInfo.pPipelineCreationFeedback = &creationFeedback;
+        computePipelineInfo.pNext = &creationFeedbackInfo;
+    }
+    // Without feedback, the estimate is off when other threads add pipelines to the cache meanwhile.
+    size_t cacheSizeBefore = mSupportsCreationFeedback ? 0 : getPipelineCacheDataSize();
+
+    // gfx creates pipelines when they are bound, usually on the render thread. The pipeline is
+    // created right away rather than queued behind long compile tasks, and its time is recorded
+    // with the task scheduler statistics.
+    CpuTimer timer;
+    timer.update();
+    VkPipeline pipeline;
+    VkResult result = mVkCreateComputePipelines(mVkDevice, mPipelineCache, 1, &computePipelineInfo, nullptr, &pipeline);
+    timer.update();
+    if (mpTaskScheduler)
+        mpTaskScheduler->recordTask("vkCreateComputePipelines", 0.0, timer.delta());
+
+    *((VkPipeline*)outPipelineState) = pipeline;
 
-Device::Device()
+    if (result != VK_SUCCESS)
+        return SLANG_FAIL;
+
+    bool hit;
+    if (creationFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT)
+        hit = (creationFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT) != 0;
+    else
+        hit = mPipelineCache != VK_NULL_HANDLE && getPipelineCacheDataSize() <= cacheSizeBefore;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLastCreationTime = timer.delta();
+    if (hit)
+    {
+        mPipelineCacheStats.hitCount++;
+        mPipelineCacheStats.hitTime += timer.delta();
+    }
+    else
+    {
+        mPipelineCacheStats.missCount++;
+        mPipelineCacheStats.missTime += timer.delta();
+    }
+    return SLANG_OK;
+}
+
+Device::Device() : Device(Desc()) {}
+
+Device::Device(const Desc& desc)
 {
     printf("slang: create global session\n");
-    slang::createGlobalSession(m_slangGlobalSession.writeRef());
+    CpuTimer timer;
+    timer.update();
+    mCoreModuleSnapshotPath = desc.coreModuleSnapshotPath;
+    if (!mCoreModuleSnapshotPath.empty())
+        m_slangGlobalSession = createGlobalSessionFromSnapshot(mCoreModuleSnapshotPath);
+    mCoreModuleSnapshotLoaded = m_slangGlobalSession != nullptr;
+    if (!m_slangGlobalSession)
+        slang::createGlobalSession(m_slangGlobalSession.writeRef());
+    timer.update();
+    mSlangStartupTime = timer.delta();
+    mpTaskScheduler = std::make_unique<TaskScheduler>(desc.taskWorkerCount);
     m_pProgramManager = std::make_unique<ProgramManager>(this);
 
     gfx::IDevice::Desc gfxDesc = {};
     gfxDesc.deviceType = gfx::DeviceType::Vulkan;
     gfxDesc.slang.slangGlobalSession = m_slangGlobalSession;
-    gfxDesc.shaderCache.maxEntryCount = 1000;
+    gfxDesc.shaderCache.maxEntryCount = desc.shaderCacheMaxEntryCount;
     gfxDesc.shaderCache.shaderCachePath = nullptr;
+    if (!desc.shaderCachePath.empty())
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(desc.shaderCachePath, ec);
+        if (ec)
+        {
+            printf("Warning: Failed to create shader cache directory %s\n", desc.shaderCachePath.string().c_str());
+        }
+        else
+        {
+            mShaderCachePath = desc.shaderCachePath;
+            mShaderCachePathString = desc.shaderCachePath.string();
+            mShaderCacheMaxBytes = desc.shaderCacheMaxBytes;
+            evictShaderCacheEntries();
+            gfxDesc.shaderCache.shaderCachePath = mShaderCachePathString.c_str();
+        }
+    }
 
     printf("gfx:: get GPU adapters\n");
     gfx::AdapterList adapters = gfx::gfxGetAdapters(gfxDesc.deviceType);
@@ -23,7 +283,7 @@ Device::Device()
     // Try to create device on specific GPU.
     gfxDesc.adapterLUID = &adapters.getAdapters()[0].luid;
 
-    mpAPIDispatcher.reset(new PipelineCreationAPIDispatcher());
+    mpAPIDispatcher.reset(new PipelineCreationAPIDispatcher(desc.pipelineCachePath, mpTaskScheduler.get()));
     gfxDesc.apiCommandDispatcher = static_cast<ISlangUnknown*>(mpAPIDispatcher.get());
 
     printf("gfx create device\n");
@@ -49,6 +309,12 @@ Device::Device()
             assert(!"Failed to create device");
     }
 
+    if (!mShaderCachePath.empty())
+    {
+        if (SLANG_FAILED(m_gfxDevice->queryInterface(SLANG_UUID_IShaderCache, (void**)m_gfxShaderCache.writeRef())))
+            printf("Warning: gfx device does not expose shader cache statistics\n");
+    }
+
     gfx::ITransientResourceHeap::Desc transientHeapDesc = {};
     transientHeapDesc.flags = gfx::ITransientResourceHeap::Flags::AllowResizing;
     transientHeapDesc.constantBufferSize = 16 * 1024 * 1024;
@@ -65,7 +331,100 @@ Device::Device()
 Device::~Device()
 {
     m_pProgramManager.reset();
+    mpAPIDispatcher->releasePipelineCache();
+    m_gfxShaderCache.setNull();
     m_gfxDevice.setNull();
     m_transientResourceHeaps.setNull();
     mpAPIDispatcher.reset();
+
+    // gfx writes its shader cache index when the device is released, trim the directory afterwards.
+    if (!mShaderCachePath.empty())
+        evictShaderCacheEntries();
+}
+
+namespace
+{
+struct ShaderCacheFile
+{
+    std::filesystem::path path;
+    std::filesystem::file_time_type modifiedTime;
+    uint64_t size;
+};
+
+uint64_t collectShaderCacheFiles(const std::filesystem::path& directory, std::vector<ShaderCacheFile>* pFiles)
+{
+    uint64_t totalSize = 0;
+    std::error_code ec;
+    for (std::filesystem::recursive_directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+    {
+        std::error_code fileEc;
+        if (!it->is_regular_file(fileEc))
+            continue;
+        ShaderCacheFile file{it->path(), it->last_write_time(fileEc), it->file_size(fileEc)};
+        if (fileEc)
+            continue;
+        totalSize += file.size;
+        if (pFiles)
+            pFiles->push_back(std::move(file));
+    }
+    return totalSize;
+}
+} // namespace
+
+void Device::evictShaderCacheEntries()
+{
+    std::vector<ShaderCacheFile> files;
+    uint64_t totalSize = collectShaderCacheFiles(mShaderCachePath, &files);
+    if (totalSize <= mShaderCacheMaxBytes)
+        return;
+
+    // gfx only knows about entries through its index and treats missing entry files as misses,
+    // so removing files behind its back is safe.
+    std::sort(
+        files.begin(),
+        files.end(),
+        [](const ShaderCacheFile& a, const ShaderCacheFile& b) { return a.modifiedTime < b.modifiedTime; }
+    );
+    for (const auto& file : files)
+    {
+        if (totalSize <= mShaderCacheMaxBytes)
+            break;
+        std::error_code ec;
+        if (!std::filesystem::remove(file.path, ec))
+            continue;
+        totalSize -= file.size;
+        mShaderCacheEvictedEntries++;
+        mShaderCacheEvictedBytes += file.size;
+    }
+}
+
+Slang::ComPtr<slang::IGlobalSession> Device::createSlangGlobalSession() const
+{
+    Slang::ComPtr<slang::IGlobalSession> pGlobalSession;
+    if (mCoreModuleSnapshotLoaded)
+        pGlobalSession = createGlobalSessionFromSnapshot(mCoreModuleSnapshotPath);
+    if (!pGlobalSession)
+        slang::createGlobalSession(pGlobalSession.writeRef());
+    return pGlobalSession;
+}
+
+Device::ShaderCacheStats Device::getShaderCacheStats() const
+{
+    ShaderCacheStats stats;
+    if (mShaderCachePath.empty())
+        return stats;
+    if (m_gfxShaderCache)
+    {
+        gfx::ShaderCacheStats gfxStats = {};
+        if (SLANG_SUCCEEDED(m_gfxShaderCache->getShaderCacheStats(&gfxStats)))
+        {
+            stats.hitCount = size_t(gfxStats.hitCount);
+            stats.missCount = size_t(gfxStats.missCount);
+            stats.entryCount = size_t(gfxStats.entryCount);
+        }
+    }
+    stats.sizeInBytes = collectShaderCacheFiles(mShaderCachePath, nullptr);
+    stats.evictedEntries = mShaderCacheEvictedEntries;
+    stats.evictedBytes = mShaderCacheEvictedBytes;
+    return stats;
 }
@@ -10,12 +10,15 @@
 
 #include <slang-com-ptr.h>
 #include <slang-gfx.h>
+#include <filesystem>
 #include <memory>
+#include <mutex>
 #include "Types.h"
 #include "Object.h"
 #include "ProgramManager.h"
 #include <vulkan/vulkan.h>
 #include "CpuTimer.h"
+#include "TaskScheduler.h"
 
 class ProgramManager;
 class PipelineCreationAPIDispatcher;
@@ -44,10 +47,46 @@ static GFXDebugCallBack gGFXDebugCallBack; // TODO: REMOVEGLOBAL
 class PipelineCreationAPIDispatcher : public gfx::IPipelineCreationAPIDispatcher
 {
 public:
-    PipelineCreationAPIDispatcher() { }
+    /**
+     * Statistics of compute pipeline creation.
+     * A pipeline creation is a hit if the driver found the pipeline in the pipeline cache.
+     */
+    struct PipelineCacheStats
+    {
+        size_t hitCount = 0;         ///< Pipelines found in the pipeline cache.
+        size_t missCount = 0;        ///< Pipelines compiled by the driver.
+        double hitTime = 0.0;        ///< Total creation time of pipelines found in the cache.
+        double missTime = 0.0;       ///< Total creation time of pipelines compiled by the driver.
+        bool loadedFromDisk = false; ///< True if the pipeline cache was initialized from a valid cache file.
+    };
+
+    /**
+     * @param[in] pipelineCachePath File the Vulkan pipeline cache is loaded from and saved to. The cache is not persisted if empty.
+     * @param[in] pTaskScheduler Optional scheduler the times of Vulkan pipeline creation calls are recorded with.
+     */
+    PipelineCreationAPIDispatcher(std::filesystem::path pipelineCachePath, TaskScheduler* pTaskScheduler = nullptr)
+        : mPipelineCachePath(std::move(pipelineCachePath)), mpTaskScheduler(pTaskScheduler)
+    { }
     ~PipelineCreationAPIDispatcher() { }
 
-    double getPipelineCreationTime() {return m_timer.delta();}
+    /// Creation time of the last pipeline, in seconds.
+    double getPipelineCreationTime()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mLastCreationTime;
+    }
+
+    PipelineCacheStats getPipelineCacheStats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mPipelineCacheStats;
+    }
+
+    /**
+     * Save the pipeline cache to disk (if a path was given) and destroy it.
+     * Must be called before the gfx device is destroyed.
+     */
+    void releasePipelineCache();
 
     virtual SLANG_NO_THROW SlangResult SLANG_MCALL queryInterface(SlangUUID const& uuid, void** outObject) override
     {
@@ -71,70 +110,7 @@ public:
         slang::IComponentType* program,
         void* pipelineDesc,
         void** outPipelineState
-    )
-    {
-        const char* dynamicLibraryName = "Unknown";
-
-#if defined(Linux)
-        dynamicLibraryName = "libvulkan.so.1";
-        void* vulkanLibraryHandle = dlopen(dynamicLibraryName, RTLD_NOW);
-#elif defined(_WIN32)
-        dynamicLibraryName = "vulkan-1.dll";
-        HMODULE vulkanLibraryHandle = ::LoadLibraryA(dynamicLibraryName);
-#else
-#error "No OS specified"
-#endif
-
-        gfx::IDevice::InteropHandles outHandles;
-        device->getNativeDeviceHandles(&outHandles);
-
-        VkInstance instance;
-        instance = (VkInstance)outHandles.handles[0].handleValue;
-
-        VkDevice vkDevice;
-        vkDevice = (VkDevice)outHandles.handles[2].handleValue;
-
-        PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = nullptr;
-
-#if defined(Linux)
-        vkGetInstanceProcAddr = (PFN_vkGetInstanceProcAddr)dlsym(vulkanLibraryHandle, "vkGetInstanceProcAddr");
-#elif defined(_WIN32)
-        vkGetInstanceProcAddr = (PFN_vkGetInstanceProcAddr)::GetProcAddress(vulkanLibraryHandle, "vkGetInstanceProcAddr");
-#else
-#error "No OS specified"
-#endif
-
-        if (!vkGetInstanceProcAddr)
-        {
-            assert(!"Fail to get instance proc address");
-        }
-
-        PFN_vkGetDeviceProcAddr vkGetDeviceProcAddr = nullptr;
-        vkGetDeviceProcAddr = (PFN_vkGetDeviceProcAddr)vkGetInstanceProcAddr(instance, "vkGetDeviceProcAddr");
-        if (!vkGetDeviceProcAddr)
-        {
-            assert(!"Fail to get device proc address");
-        }
-
-        PFN_vkCreateComputePipelines vkCreateComputePipelines = nullptr;
-        vkCreateComputePipelines = (PFN_vkCreateComputePipelines)vkGetDeviceProcAddr(vkDevice, "vkCreateComputePipelines");
-        if (!vkCreateComputePipelines)
-        {
-            assert(!"Fail to vkCreateComputePipelines");
-        }
-
-        m_timer.update();
-
-        VkPipelineCache pipelineCache = VK_NULL_HANDLE;
-        VkComputePipelineCreateInfo* pComputePipelineInfo = static_cast<VkComputePipelineCreateInfo*>(pipelineDesc);
-        VkPipeline pipeline;
-        vkCreateComputePipelines(
-            vkDevice, pipelineCache, 1, pComputePipelineInfo, nullptr, &pipeline);
-
-        *((VkPipeline*)outPipelineState) = pipeline;
-        m_timer.update();
-        return SLANG_OK;
-    }
+    );
 
     // This method will be called by the gfx layer to create an API object for a graphics pipeline state.
     virtual gfx::Result createGraphicsPipelineState(
@@ -173,7 +149,28 @@ public:
         return SLANG_OK;
     }
 private:
-    CpuTimer m_timer;
+    bool initVulkan(gfx::IDevice* device);
+    void createPipelineCache();
+    size_t getPipelineCacheDataSize();
+
+    /// Guards the initialization below, the creation time and the statistics. Pipelines can be created from several threads.
+    mutable std::mutex mMutex;
+    double mLastCreationTime = 0.0;
+
+    // Vulkan entry points are loaded on the first pipeline creation.
+    bool mVulkanInitialized = false;
+    VkDevice mVkDevice = VK_NULL_HANDLE;
+    bool mSupportsCreationFeedback = false;
+    PFN_vkCreateComputePipelines mVkCreateComputePipelines = nullptr;
+    PFN_vkCreatePipelineCache mVkCreatePipelineCache = nullptr;
+    PFN_vkDestroyPipelineCache mVkDestroyPipelineCache = nullptr;
+    PFN_vkGetPipelineCacheData mVkGetPipelineCacheData = nullptr;
+    VkPhysicalDeviceProperties mPhysicalDeviceProperties = {};
+
+    std::filesystem::path mPipelineCachePath;
+    VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
+    PipelineCacheStats mPipelineCacheStats;
+    TaskScheduler* mpTaskScheduler;
 };
 
 class Device  : public Object{
@@ -184,7 +181,35 @@ public:
         D3D12,
         Vulkan,
     };
+    struct Desc
+    {
+        /// File the Vulkan pipeline cache is loaded from and saved to. The pipeline cache is not persisted if empty.
+        std::filesystem::path pipelineCachePath;
+        /// Directory gfx persists compiled shader code in. Shader code is not persisted if empty.
+        std::filesystem::path shaderCachePath;
+        /// Size budget of the shader cache directory. The oldest entries are evicted when exceeded.
+        uint64_t shaderCacheMaxBytes = 512ull * 1024 * 1024;
+        /// Maximum number of entries gfx keeps in its shader cache index (gfx evicts least recently used entries).
+        uint32_t shaderCacheMaxEntryCount = 1000;
+        /// Slang core module snapshot loaded instead of compiling the core module (see `CoreModuleSnapshot.h`).
+        /// The core module is compiled if empty, or if the snapshot is missing or incompatible.
+        std::filesystem::path coreModuleSnapshotPath;
+        /// Worker threads of the task scheduler running compile, code generation and pipeline jobs. One per hardware thread if zero.
+        uint32_t taskWorkerCount = 0;
+    };
+
+    struct ShaderCacheStats
+    {
+        size_t hitCount = 0;        ///< Shader code lookups served from the gfx shader cache.
+        size_t missCount = 0;       ///< Shader code lookups that required code generation.
+        size_t entryCount = 0;      ///< Entries in the gfx shader cache index.
+        uint64_t sizeInBytes = 0;   ///< Current size of the shader cache directory.
+        size_t evictedEntries = 0;  ///< Files evicted to stay within the size budget.
+        uint64_t evictedBytes = 0;  ///< Bytes evicted to stay within the size budget.
+    };
+
     Device();
+    Device(const Desc& desc);
     ~Device();
 
     gfx::ITransientResourceHeap* getCurrentTransientResourceHeap()
@@ -198,16 +223,48 @@ public:
     }
     ProgramManager* getProgramManager() const { return m_pProgramManager.get(); }
 
+    /**
+     * Get the task scheduler shared by the program manager's compile jobs and pipeline creation.
+     */
+    TaskScheduler* getTaskScheduler() const { return mpTaskScheduler.get(); }
+
     slang::IGlobalSession* getSlangGlobalSession() const { return m_slangGlobalSession; }
+
+    /**
+     * Create another Slang global session, for compiling on threads other than the one using the device's session.
+     * The core module is loaded from the snapshot of the device description if possible.
+     */
+    Slang::ComPtr<slang::IGlobalSession> createSlangGlobalSession() const;
     gfx::IDevice* getGfxDevice() const { return m_gfxDevice; }
     Type getType() const { return m_type; }
 
     double getPipelineCreationTime() {return mpAPIDispatcher->getPipelineCreationTime();}
+    PipelineCreationAPIDispatcher::PipelineCacheStats getPipelineCacheStats() const { return mpAPIDispatcher->getPipelineCacheStats(); }
+    ShaderCacheStats getShaderCacheStats() const;
+
+    /// Time it took to create the Slang global session, in seconds.
+    double getSlangStartupTime() const { return mSlangStartupTime; }
+    /// True if the Slang core module was loaded from a snapshot.
+    bool isCoreModuleSnapshotLoaded() const { return mCoreModuleSnapshotLoaded; }
 private:
+    void evictShaderCacheEntries();
+
     Slang::ComPtr<slang::IGlobalSession> m_slangGlobalSession;
     Slang::ComPtr<gfx::IDevice> m_gfxDevice;
     Slang::ComPtr<gfx::ITransientResourceHeap> m_transientResourceHeaps;
     Type m_type {Vulkan};
+    std::unique_ptr<TaskScheduler> mpTaskScheduler; ///< Outlives the program manager, whose jobs it runs.
     std::unique_ptr<ProgramManager> m_pProgramManager;
     std::unique_ptr<PipelineCreationAPIDispatcher> mpAPIDispatcher;
+
+    Slang::ComPtr<gfx::IShaderCache> m_gfxShaderCache;
+    std::filesystem::path mShaderCachePath;
+    std::string mShaderCachePathString; ///< Keeps the path passed to gfx alive.
+    uint64_t mShaderCacheMaxBytes = 0;
+    size_t mShaderCacheEvictedEntries = 0;
+    uint64_t mShaderCacheEvictedBytes = 0;
+
+    std::filesystem::path mCoreModuleSnapshotPath;
+    double mSlangStartupTime = 0.0;
+    bool mCoreModuleSnapshotLoaded = false;
 };
@@ -0,0 +1,260 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * 128-bit hash value.
+ * Used as key for in-memory lookups and for content-addressed entries in the persistent caches.
+ */
+struct Hash128
+{
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+
+    bool isZero() const { return lo == 0 && hi == 0; }
+
+    bool operator==(const Hash128& other) const { return lo == other.lo && hi == other.hi; }
+    bool operator!=(const Hash128& other) const { return !(*this == other); }
+    bool operator<(const Hash128& other) const { return hi < other.hi || (hi == other.hi && lo < other.lo); }
+
+    /**
+     * Convert to a 32 character lower-case hex string (most significant digit first).
+     */
+    std::string toString() const
+    {
+        static const char* kDigits = "0123456789abcdef";
+        std::string str(32, '0');
+        for (int i = 0; i < 16; ++i)
+        {
+            str[15 - i] = kDigits[(hi >> (i * 4)) & 0xf];
+            str[31 - i] = kDigits[(lo >> (i * 4)) & 0xf];
+        }
+        return str;
+    }
+
+    struct HashFunction
+    {
+        size_t operator()(const Hash128& hash) const { return size_t(hash.lo ^ (hash.hi * 0x9e3779b97f4a7c15ull)); }
+    };
+};
+
+/**
+ * Incremental 128-bit hasher based on MurmurHash3 (x64, 128-bit variant).
+ * This is not a cryptographic hash. It is fast and has a good distribution, which is
+ * all we need for building cache keys.
+ */
+class Hasher
+{
+public:
+    explicit Hasher(uint64_t seed = 0) : mH1(seed), mH2(seed) {}
+
+    /**
+     * Hash a block of raw memory.
+     */
+    void update(const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        mLength += size;
+
+        // Complete a partially filled block first.
+        if (mTailSize > 0)
+        {
+            size_t count = std::min(size, sizeof(mTail) - mTailSize);
+            std::memcpy(mTail + mTailSize, bytes, count);
+            mTailSize += count;
+            bytes += count;
+            size -= count;
+            if (mTailSize < sizeof(mTail))
+                return;
+            processBlock(mTail);
+            mTailSize = 0;
+        }
+
+        while (size >= sizeof(mTail))
+        {
+            processBlock(bytes);
+            bytes += sizeof(mTail);
+            size -= sizeof(mTail);
+        }
+
+        if (size > 0)
+        {
+            std::memcpy(mTail, bytes, size);
+            mTailSize = size;
+        }
+    }
+
+    /**
+     * Hash a string. The length is hashed as well so that consecutive strings can't alias.
+     */
+    void update(std::string_view str)
+    {
+        update(uint64_t(str.size()));
+        update(str.data(), str.size());
+    }
+
+    void update(const std::string& str) { update(std::string_view(str)); }
+    void update(const char* str) { update(std::string_view(str)); }
+
+    void update(const Hash128& hash)
+    {
+        update(hash.lo);
+        update(hash.hi);
+    }
+
+    /**
+     * Hash a scalar value (integers, floats, enums).
+     */
+    template<typename T, typename = std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>>>
+    void update(T value)
+    {
+        update(&value, sizeof(value));
+    }
+
+    /**
+     * Get the digest of all data hashed so far. The hasher can continue to be used afterwards.
+     */
+    Hash128 getDigest() const
+    {
+        uint64_t h1 = mH1;
+        uint64_t h2 = mH2;
+
+        uint64_t k1 = 0;
+        uint64_t k2 = 0;
+        for (size_t i = mTailSize; i > 8; --i)
+            k2 |= uint64_t(mTail[i - 1]) << ((i - 9) * 8);
+        for (size_t i = std::min<size_t>(mTailSize, 8); i > 0; --i)
+            k1 |= uint64_t(mTail[i - 1]) << ((i - 1) * 8);
+
+        if (mTailSize > 8)
+        {
+            k2 *= kC2;
+            k2 = rotl(k2, 33);
+            k2 *= kC1;
+            h2 ^= k2;
+        }
+        if (mTailSize > 0)
+        {
+            k1 *= kC1;
+            k1 = rotl(k1, 31);
+            k1 *= kC2;
+            h1 ^= k1;
+        }
+
+        h1 ^= mLength;
+        h2 ^= mLength;
+        h1 += h2;
+        h2 += h1;
+        h1 = fmix(h1);
+        h2 = fmix(h2);
+        h1 += h2;
+        h2 += h1;
+
+        return Hash128{h1, h2};
+    }
+
+private:
+    static constexpr uint64_t kC1 = 0x87c37b91114253d5ull;
+    static constexpr uint64_t kC2 = 0x4cf5ad432745937full;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t fmix(uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdull;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ull;
+        k ^= k >> 33;
+        return k;
+    }
+
+    void processBlock(const uint8_t* block)
+    {
+        uint64_t k1;
+        uint64_t k2;
+        std::memcpy(&k1, block, 8);
+        std::memcpy(&k2, block + 8, 8);
+
+        k1 *= kC1;
+        k1 = rotl(k1, 31);
+        k1 *= kC2;
+        mH1 ^= k1;
+        mH1 = rotl(mH1, 27);
+        mH1 += mH2;
+        mH1 = mH1 * 5 + 0x52dce729;
+
+        k2 *= kC2;
+        k2 = rotl(k2, 33);
+        k2 *= kC1;
+        mH2 ^= k2;
+        mH2 = rotl(mH2, 31);
+        mH2 += mH1;
+        mH2 = mH2 * 5 + 0x38495ab5;
+    }
+
+    uint64_t mH1;
+    uint64_t mH2;
+    uint8_t mTail[16];
+    size_t mTailSize = 0;
+    uint64_t mLength = 0;
+};
+
+/**
+ * Hash a block of memory.
+ */
+inline Hash128 hash128(const void* data, size_t size)
+{
+    Hasher hasher;
+    hasher.update(data, size);
+    return hasher.getDigest();
+}
+
+/**
+ * Order-independent hash of a multiset of entries that can be updated incrementally.
+ * Every entry contributes its own 128-bit hash, the accumulated value is the lane-wise sum
+ * of all contributions. Adding or removing an entry is O(1), and the digest only depends on
+ * the entries, not on the order in which they were added.
+ */
+class MultisetHash
+{
+public:
+    void add(const Hash128& entry)
+    {
+        mSum.lo += entry.lo;
+        mSum.hi += entry.hi;
+        mCount++;
+    }
+
+    void remove(const Hash128& entry)
+    {
+        mSum.lo -= entry.lo;
+        mSum.hi -= entry.hi;
+        mCount--;
+    }
+
+    void clear() { *this = MultisetHash(); }
+
+    /**
+     * Get the digest of the current set of entries. The sum is mixed with the entry count
+     * so the digest is well distributed even for small sets.
+     */
+    Hash128 getDigest() const
+    {
+        Hasher hasher;
+        hasher.update(mCount);
+        hasher.update(mSum);
+        return hasher.getDigest();
+    }
+
+private:
+    Hash128 mSum;
+    uint64_t mCount = 0;
+};
@@ -0,0 +1,215 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#include "PermutationManifest.h"
+
+namespace
+{
+/// Identifies permutation manifest files ('FPMF').
+const uint32_t kManifestMagic = 0x464d5046;
+/// Bump when the record layout changes.
+const uint32_t kManifestVersion = 1;
+
+struct ManifestHeader
+{
+    uint32_t magic;
+    uint32_t version;
+};
+
+void writeU32(std::vector<uint8_t>& data, uint32_t value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(value));
+}
+
+void writeU64(std::vector<uint8_t>& data, uint64_t value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(value));
+}
+
+void writeString(std::vector<uint8_t>& data, const std::string& str)
+{
+    writeU32(data, uint32_t(str.size()));
+    data.insert(data.end(), str.begin(), str.end());
+}
+
+bool readU32(const std::vector<uint8_t>& data, size_t& offset, uint32_t& value)
+{
+    if (data.size() - offset < sizeof(value))
+        return false;
+    std::memcpy(&value, data.data() + offset, sizeof(value));
+    offset += sizeof(value);
+    return true;
+}
+
+bool readU64(const std::vector<uint8_t>& data, size_t& offset, uint64_t& value)
+{
+    if (data.size() - offset < sizeof(value))
+        return false;
+    std::memcpy(&value, data.data() + offset, sizeof(value));
+    offset += sizeof(value);
+    return true;
+}
+
+bool readString(const std::vector<uint8_t>& data, size_t& offset, std::string& str)
+{
+    uint32_t size;
+    if (!readU32(data, offset, size) || data.size() - offset < size)
+        return false;
+    str.assign(reinterpret_cast<const char*>(data.data() + offset), size);
+    offset += size;
+    return true;
+}
+
+void serializeEntry(const PermutationManifest::Entry& entry, std::vector<uint8_t>& data)
+{
+    writeU64(data, entry.programKey.lo);
+    writeU64(data, entry.programKey.hi);
+    writeU32(data, uint32_t(entry.defines.size()));
+    for (const auto& define : entry.defines)
+    {
+        writeString(data, define.first);
+        writeString(data, define.second);
+    }
+    writeU32(data, uint32_t(entry.typeConformances.size()));
+    for (const auto& conformance : entry.typeConformances)
+    {
+        writeString(data, conformance.first.typeName);
+        writeString(data, conformance.first.interfaceName);
+        writeU32(data, conformance.second);
+    }
+}
+
+bool deserializeEntry(const std::vector<uint8_t>& data, size_t& offset, PermutationManifest::Entry& entry)
+{
+    uint32_t defineCount;
+    if (!readU64(data, offset, entry.programKey.lo) || !readU64(data, offset, entry.programKey.hi) || !readU32(data, offset, defineCount))
+        return false;
+    for (uint32_t i = 0; i < defineCount; ++i)
+    {
+        std::string name, value;
+        if (!readString(data, offset, name) || !readString(data, offset, value))
+            return false;
+        entry.defines.add(name, value);
+    }
+
+    uint32_t conformanceCount;
+    if (!readU32(data, offset, conformanceCount))
+        return false;
+    for (uint32_t i = 0; i < conformanceCount; ++i)
+    {
+        std::string typeName, interfaceName;
+        uint32_t id;
+        if (!readString(data, offset, typeName) || !readString(data, offset, interfaceName) || !readU32(data, offset, id))
+            return false;
+        entry.typeConformances.add(typeName, interfaceName, id);
+    }
+    return true;
+}
+} // namespace
+
+PermutationManifest::PermutationManifest(std::filesystem::path path) : mPath(std::move(path))
+{
+    std::ifstream file(mPath, std::ios::binary);
+    if (!file)
+        return;
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    ManifestHeader header;
+    if (data.size() < sizeof(header))
+        return;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != kManifestMagic || header.version != kManifestVersion)
+    {
+        printf("Warning: Ignoring permutation manifest %s with unknown format\n", mPath.string().c_str());
+        return;
+    }
+    mValidHeader = true;
+
+    size_t offset = sizeof(header);
+    size_t validSize = offset;
+    uint32_t recordSize;
+    while (readU32(data, offset, recordSize) && data.size() - offset >= recordSize)
+    {
+        size_t recordOffset = offset;
+        offset += recordSize;
+        validSize = offset;
+
+        Entry entry;
+        if (!deserializeEntry(data, recordOffset, entry) || recordOffset != offset)
+            continue;
+        if (mEntryKeys.insert(computeEntryKey(entry)).second)
+            mEntries.push_back(std::move(entry));
+    }
+
+    // Drop a partially written record so new records are appended at a record boundary.
+    if (validSize != data.size())
+    {
+        file.close();
+        std::error_code ec;
+        std::filesystem::resize_file(mPath, validSize, ec);
+        if (ec)
+            mValidHeader = false;
+    }
+}
+
+Hash128 PermutationManifest::computeEntryKey(const Entry& entry)
+{
+    Hasher hasher;
+    hasher.update(entry.programKey);
+    hasher.update(uint64_t(entry.defines.size()));
+    for (const auto& define : entry.defines)
+    {
+        hasher.update(define.first);
+        hasher.update(define.second);
+    }
+    hashTypeConformanceList(hasher, entry.typeConformances);
+    return hasher.getDigest();
+}
+
+bool PermutationManifest::record(const Entry& entry)
+{
+    if (!mEntryKeys.insert(computeEntryKey(entry)).second)
+        return false;
+    mEntries.push_back(entry);
+
+    std::vector<uint8_t> payload;
+    serializeEntry(entry, payload);
+    std::vector<uint8_t> record;
+    writeU32(record, uint32_t(payload.size()));
+    record.insert(record.end(), payload.begin(), payload.end());
+    if (!append(record))
+        printf("Warning: Failed to write permutation manifest %s\n", mPath.string().c_str());
+    return true;
+}
+
+bool PermutationManifest::append(const std::vector<uint8_t>& record)
+{
+    // Start a new file if there is none yet, or if the existing one has an unknown format.
+    std::ios::openmode mode = std::ios::binary | (mValidHeader ? std::ios::app : std::ios::trunc);
+    if (!mValidHeader)
+    {
+        std::error_code ec;
+        if (mPath.has_parent_path())
+            std::filesystem::create_directories(mPath.parent_path(), ec);
+    }
+
+    std::ofstream file(mPath, mode);
+    if (!file)
+        return false;
+    if (!mValidHeader)
+    {
+        ManifestHeader header = {kManifestMagic, kManifestVersion};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        mValidHeader = bool(file);
+    }
+    file.write(reinterpret_cast<const char*>(record.data()), record.size());
+    return bool(file);
+}
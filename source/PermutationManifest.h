@@ -0,0 +1,54 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#pragma once
+#include <filesystem>
+#include <unordered_set>
+#include <vector>
+
+#include "DefineList.h"
+#include "Hash.h"
+#include "Program.h"
+
+/**
+ * Append-only record of the program permutations an application compiled.
+ *
+ * An entry identifies a permutation by the key of the program description it belongs to
+ * and the program's macro definitions and type conformances. The file starts with a header
+ * followed by size-prefixed records, so entries can be appended cheaply as they are compiled.
+ * A truncated record at the end of the file (e.g. from a crash while appending) is ignored.
+ */
+class PermutationManifest
+{
+public:
+    struct Entry
+    {
+        Hash128 programKey; ///< Key of the program description (shader modules and entry points).
+        DefineList defines;
+        TypeConformanceList typeConformances;
+    };
+
+    /**
+     * Open a manifest file and load its entries. The file is created when the first entry is recorded.
+     */
+    explicit PermutationManifest(std::filesystem::path path);
+
+    const std::filesystem::path& getPath() const { return mPath; }
+
+    const std::vector<Entry>& getEntries() const { return mEntries; }
+
+    /**
+     * Record a permutation. Permutations that were recorded before are ignored.
+     * @return True if the entry was new.
+     */
+    bool record(const Entry& entry);
+
+private:
+    static Hash128 computeEntryKey(const Entry& entry);
+    bool append(const std::vector<uint8_t>& record);
+
+    std::filesystem::path mPath;
+    std::vector<Entry> mEntries;
+    std::unordered_set<Hash128, Hash128::HashFunction> mEntryKeys;
+    bool mValidHeader = false; ///< True if the file exists and has a valid header.
+};
@@ -8,6 +8,26 @@
 #include "Program.h"
 #include "DefineList.h"
 
+namespace
+{
+Hash128 hashDefine(const std::string& name, const std::string& value)
+{
+    Hasher hasher;
+    hasher.update(name);
+    hasher.update(value);
+    return hasher.getDigest();
+}
+
+Hash128 hashTypeConformance(const TypeConformance& conformance, uint32_t id)
+{
+    Hasher hasher;
+    hasher.update(conformance.typeName);
+    hasher.update(conformance.interfaceName);
+    hasher.update(id);
+    return hasher.getDigest();
+}
+} // namespace
+
 void ProgramDesc::finalize()
 {
     uint32_t globalIndex = 0;
@@ -17,9 +37,19 @@ void ProgramDesc::finalize()
 }
 
 Program::Program(ref<Device> pDevice, ProgramDesc desc, DefineList defineList)
-    : mpDevice(std::move(pDevice)), mDesc(std::move(desc)), mDefineList(std::move(defineList)), mTypeConformanceList(mDesc.typeConformances)
+    : Program(std::move(pDevice), std::move(desc), std::move(defineList), true)
+{}
+
+Program::Program(ref<Device> pDevice, ProgramDesc desc, DefineList defineList, bool registerForReload)
+    : mpDevice(std::move(pDevice))
+    , mDesc(std::move(desc))
+    , mDefineList(std::move(defineList))
+    , mTypeConformanceList(mDesc.typeConformances)
+    , mRegisteredForReload(registerForReload)
 {
     mDesc.finalize();
+    rehashDefineList();
+    rehashTypeConformanceList();
 
     // If not shader model was requested, use the default shader model for the device.
     if (mDesc.shaderModel == ShaderModel::Unknown)
@@ -41,16 +71,25 @@ Program::Program(ref<Device> pDevice, ProgramDesc desc, DefineList defineList)
 
     validateEntryPoints();
 #endif
-    mpDevice->getProgramManager()->registerProgramForReload(this);
+    if (mRegisteredForReload)
+        mpDevice->getProgramManager()->registerProgramForReload(this);
 }
 
 Program::~Program()
 {
-    mpDevice->getProgramManager()->unregisterProgramForReload(this);
+    // Unregister first, so that a reload running on another thread no longer sees the program.
+    if (mRegisteredForReload)
+    {
+        mpDevice->getProgramManager()->unregisterProgramForReload(this);
+        mpDevice->getProgramManager()->forgetProgramVersions(*this);
+    }
 
-    // Invalidate program versions.
+    // Invalidate program versions. Versions compiled in the background refer to a copy they keep alive.
     for (auto& version : mProgramVersions)
-        version.second->mpProgram = nullptr;
+    {
+        if (version.second->mpProgram == this)
+            version.second->mpProgram = nullptr;
+    }
 }
 
 std::string Program::getProgramDescString() const
@@ -95,16 +134,19 @@ std::string Program::getProgramDescString() const
 bool Program::addDefine(const std::string& name, const std::string& value)
 {
     // Make sure that it doesn't exist already
-    if (mDefineList.find(name) != mDefineList.end())
+    auto it = mDefineList.find(name);
+    if (it != mDefineList.end())
     {
-        if (mDefineList[name] == value)
+        if (it->second == value)
         {
             // Same define
             return false;
         }
+        mDefineListHash.remove(hashDefine(it->first, it->second));
     }
     markDirty();
     mDefineList[name] = value;
+    mDefineListHash.add(hashDefine(name, value));
     return true;
 }
 
@@ -123,10 +165,12 @@ bool Program::addDefines(const DefineList& dl)
 
 bool Program::removeDefine(const std::string& name)
 {
-    if (mDefineList.find(name) != mDefineList.end())
+    auto it = mDefineList.find(name);
+    if (it != mDefineList.end())
     {
         markDirty();
-        mDefineList.erase(name);
+        mDefineListHash.remove(hashDefine(it->first, it->second));
+        mDefineList.erase(it);
         return true;
     }
     return false;
@@ -153,6 +197,7 @@ bool Program::removeDefines(size_t pos, size_t len, const std::string& str)
         if (pos < it->first.length() && it->first.compare(pos, len, str) == 0)
         {
             markDirty();
+            mDefineListHash.remove(hashDefine(it->first, it->second));
             it = mDefineList.erase(it);
             dirty = true;
         }
@@ -170,6 +215,7 @@ bool Program::setDefines(const DefineList& dl)
     {
         markDirty();
         mDefineList = dl;
+        rehashDefineList();
         return true;
     }
     return false;
@@ -182,6 +228,7 @@ bool Program::addTypeConformance(const std::string& typeName, const std::string
     {
         markDirty();
         mTypeConformanceList.add(typeName, interfaceType, id);
+        mTypeConformanceListHash.add(hashTypeConformance(conformance, id));
         return true;
     }
     return false;
@@ -190,10 +237,12 @@ bool Program::addTypeConformance(const std::string& typeName, const std::string
 bool Program::removeTypeConformance(const std::string& typeName, const std::string interfaceType)
 {
     TypeConformance conformance = TypeConformance(typeName, interfaceType);
-    if (mTypeConformanceList.find(conformance) != mTypeConformanceList.end())
+    auto it = mTypeConformanceList.find(conformance);
+    if (it != mTypeConformanceList.end())
     {
         markDirty();
-        mTypeConformanceList.remove(typeName, interfaceType);
+        mTypeConformanceListHash.remove(hashTypeConformance(it->first, it->second));
+        mTypeConformanceList.erase(it);
         return true;
     }
     return false;
@@ -205,53 +254,225 @@ bool Program::setTypeConformances(const TypeConformanceList& conformances)
     {
         markDirty();
         mTypeConformanceList = conformances;
+        rehashTypeConformanceList();
         return true;
     }
     return false;
 }
 
-const ref<const ProgramVersion>& Program::getActiveVersion() const
+void Program::rehashDefineList()
 {
+    mDefineListHash.clear();
+    for (const auto& define : mDefineList)
+        mDefineListHash.add(hashDefine(define.first, define.second));
+}
+
+void Program::rehashTypeConformanceList()
+{
+    mTypeConformanceListHash.clear();
+    for (const auto& conformance : mTypeConformanceList)
+        mTypeConformanceListHash.add(hashTypeConformance(conformance.first, conformance.second));
+}
+
+Hash128 Program::getVersionFingerprint() const
+{
+    Hasher hasher;
+    hasher.update(mDefineListHash.getDigest());
+    hasher.update(mTypeConformanceListHash.getDigest());
+    return hasher.getDigest();
+}
+
+ref<const ProgramVersion> Program::getActiveVersion() const
+{
+    std::unique_lock<std::mutex> lock(mVersionMutex);
+    waitForPrecompiledVersion(lock);
     if (mLinkRequired)
+        updateActiveVersion(nullptr, 0);
+    touchActiveVersion();
+
+    if (!mpActiveVersion) {
+        assert(!"Invalid active version");
+    }
+    return mpActiveVersion;
+}
+
+std::shared_future<ref<const ProgramVersion>> Program::requestActiveVersion() const
+{
+    std::lock_guard<std::mutex> lock(mVersionMutex);
+    const Hash128 fingerprint = getVersionFingerprint();
+    mVersionRequested = true;
+    mRequestedFingerprint = fingerprint;
+    mRequestTime = CpuTimer::getCurrentTimePoint();
+
+    // Versions that are compiled already are swapped in right away.
+    if (!mLinkRequired || mProgramVersions.count(fingerprint) != 0)
     {
-        const auto& it = mProgramVersions.find(ProgramVersionKey{mDefineList, mTypeConformanceList});
-        if (it == mProgramVersions.end())
+        updateActiveVersion(nullptr, 0);
+        std::promise<ref<const ProgramVersion>> promise;
+        promise.set_value(mpActiveVersion);
+        return promise.get_future().share();
+    }
+
+    // A pending permutation precompile is turned into a request (see ProgramManager::queuePrecompile()).
+    auto it = mPrecompiledVersions.find(fingerprint);
+    if (it != mPrecompiledVersions.end() && it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        return it->second;
+    std::shared_future<ref<const ProgramVersion>> future = mpDevice->getProgramManager()->requestProgramVersion(*this);
+    mPrecompiledVersions[fingerprint] = future;
+    return future;
+}
+
+ref<const ProgramVersion> Program::getServedVersion() const
+{
+    // Don't wait for another thread compiling a version of the program.
+    std::unique_lock<std::mutex> lock(mVersionMutex, std::try_to_lock);
+    if (lock.owns_lock() && mVersionRequested)
+    {
+        const Hash128 fingerprint = getVersionFingerprint();
+        auto it = mPrecompiledVersions.find(fingerprint);
+        if (fingerprint != mRequestedFingerprint)
         {
-            // Note that link() updates mActiveProgram only if the operation was successful.
-            // On error we get false, and mActiveProgram points to the last successfully compiled version.
-            if (link() == false)
-            {
-                assert(!"Program linkage failed");
-            }
-            else
+            // The defines or type conformances changed again without a new request.
+            mVersionRequested = false;
+        }
+        else if (!mLinkRequired || (it != mPrecompiledVersions.end() && it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready))
+        {
+            // Only swap in a version that is compiled already, never compile here.
+            if (!swapInVersion(false))
             {
-                mProgramVersions[ProgramVersionKey{mDefineList, mTypeConformanceList}] = mpActiveVersion;
+                // Keep serving the last good version. getActiveVersion() compiles again and reports the errors.
+                mVersionRequested = false;
             }
         }
-        else
+        else if (it == mPrecompiledVersions.end())
         {
-            mpActiveVersion = it->second;
+            mVersionRequested = false;
         }
-        mLinkRequired = false;
     }
 
-    if (!mpActiveVersion) {
-        assert(!"Invalid active version");
-    }
+    std::lock_guard<std::mutex> servedLock(mServedVersionMutex);
+    return mpServedVersion;
+}
+
+double Program::getLastSwapTime() const
+{
+    std::lock_guard<std::mutex> lock(mServedVersionMutex);
+    return mLastSwapTime;
+}
+
+ref<const ProgramVersion> Program::activateVersion(std::string& log, uint32_t slangContext) const
+{
+    std::unique_lock<std::mutex> lock(mVersionMutex);
+    waitForPrecompiledVersion(lock);
+    if (mLinkRequired && !updateActiveVersion(&log, slangContext))
+        return nullptr;
+    touchActiveVersion();
     return mpActiveVersion;
 }
 
-bool Program::link() const
+void Program::waitForPrecompiledVersion(std::unique_lock<std::mutex>& lock) const
+{
+    const TaskScheduler* pScheduler = mpDevice->getTaskScheduler();
+    if (pScheduler->getCurrentWorkerIndex() < pScheduler->getWorkerCount())
+        return;
+
+    while (mLinkRequired)
+    {
+        auto it = mPrecompiledVersions.find(getVersionFingerprint());
+        if (it == mPrecompiledVersions.end() || it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+            return;
+
+        // Other threads may use the program meanwhile, so look the version up again afterwards.
+        std::shared_future<ref<const ProgramVersion>> future = it->second;
+        lock.unlock();
+        future.wait();
+        lock.lock();
+    }
+}
+
+bool Program::updateActiveVersion(std::string* pLog, uint32_t slangContext) const
+{
+    if (swapInVersion(true))
+        return true;
+
+    // Note that link() updates mActiveProgram only if the operation was successful.
+    // On error we get false, and mActiveProgram points to the last successfully compiled version.
+    if (link(pLog, slangContext) == false)
+        return false;
+    setActiveVersion(getVersionFingerprint(), mpActiveVersion);
+    return true;
+}
+
+bool Program::swapInVersion(bool runPrecompile) const
+{
+    const Hash128 fingerprint = getVersionFingerprint();
+    const auto& it = mProgramVersions.find(fingerprint);
+    if (it != mProgramVersions.end())
+    {
+        setActiveVersion(fingerprint, it->second);
+        return true;
+    }
+
+    // Permutations from the permutation manifest are compiled in the background.
+    const auto& precompileIt = mPrecompiledVersions.find(fingerprint);
+    if (precompileIt == mPrecompiledVersions.end())
+        return false;
+    if (!runPrecompile && precompileIt->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+    ref<const ProgramVersion> pPrecompiledVersion = mpDevice->getProgramManager()->takePrecompiledVersion(*this, fingerprint);
+    if (!pPrecompiledVersion)
+        return false;
+    setActiveVersion(fingerprint, pPrecompiledVersion);
+    return true;
+}
+
+void Program::setActiveVersion(const Hash128& fingerprint, const ref<const ProgramVersion>& pVersion) const
+{
+    mpActiveVersion = pVersion;
+    mProgramVersions[fingerprint] = pVersion;
+    mLinkRequired = false;
+    mTouchPending = mRegisteredForReload;
+
+    // Swap the version in for getServedVersion().
+    const bool requested = mVersionRequested && fingerprint == mRequestedFingerprint;
+    const double swapTime = requested ? CpuTimer::calcDuration(mRequestTime, CpuTimer::getCurrentTimePoint()) * 1.0e-3 : 0.0;
+    {
+        std::lock_guard<std::mutex> lock(mServedVersionMutex);
+        mpServedVersion = mpActiveVersion;
+        if (requested)
+            mLastSwapTime = swapTime;
+    }
+    if (requested)
+    {
+        mVersionRequested = false;
+        mpDevice->getProgramManager()->recordVersionSwap(swapTime);
+    }
+}
+
+void Program::touchActiveVersion() const
+{
+    if (!mTouchPending || !mpActiveVersion)
+        return;
+    mTouchPending = false;
+    mpDevice->getProgramManager()->touchProgramVersion(*this, getVersionFingerprint(), mpActiveVersion.get());
+}
+
+bool Program::link(std::string* pLog, uint32_t slangContext) const
 {
     while (1)
     {
         // Create the program
         std::string log;
-        auto pVersion = mpDevice->getProgramManager()->createProgramVersion(*this, log);
+        auto pVersion = mpDevice->getProgramManager()->createProgramVersion(*this, log, slangContext);
 
         if (pVersion == nullptr)
         {
             std::string msg = "Failed to link program:\n" + getProgramDescString() + "\n\n" + log;
+            if (pLog)
+            {
+                *pLog += msg;
+                return false;
+            }
             printf("%s\n", msg.c_str());
             assert(0);
         }
@@ -259,7 +480,10 @@ bool Program::link() const
         {
             if (!log.empty())
             {
-                printf("Warnings in program:\n%s\n%s", getProgramDescString().c_str(), log.c_str());
+                if (pLog)
+                    *pLog += log;
+                else
+                    printf("Warnings in program:\n%s\n%s", getProgramDescString().c_str(), log.c_str());
             }
 
             mpActiveVersion = pVersion;
@@ -268,11 +492,26 @@ bool Program::link() const
     }
 }
 
+bool Program::checkIfFilesChanged()
+{
+    std::lock_guard<std::mutex> lock(mVersionMutex);
+    for (auto& dependency : mFileDependencies)
+    {
+        if (!isShaderFileDependencyUpToDate(dependency.second))
+            return true;
+    }
+    return false;
+}
+
 void Program::reset()
 {
+    std::lock_guard<std::mutex> lock(mVersionMutex);
+    if (mRegisteredForReload)
+        mpDevice->getProgramManager()->forgetProgramVersions(*this);
     mpActiveVersion = nullptr;
     mProgramVersions.clear();
-    mFileTimeMap.clear();
+    mPrecompiledVersions.clear();
+    mFileDependencies.clear();
     mLinkRequired = true;
 }
 
@@ -5,7 +5,9 @@
  **************************************************************************/
 #pragma once
 #include <filesystem>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <string_view>
 #include <string>
 #include <map>
@@ -15,11 +17,14 @@
 #include <cassert>
 
 #include "Types.h"
+#include "CpuTimer.h"
 #include "Object.h"
 #include "DefineList.h"
 #include "DeviceWrapper.h"
+#include "Hash.h"
 #include "ProgramVersion.h"
 #include "ProgramManager.h"
+#include "ShaderFileInfo.h"
 
 class ProgramManager;
 class ProgramVersion;
@@ -104,6 +109,20 @@ public:
     TypeConformanceList(std::initializer_list<std::pair<const TypeConformance, uint32_t>> il) : std::map<TypeConformance, uint32_t>(il) {}
 };
 
+/**
+ * Hash a list of type conformances.
+ */
+inline void hashTypeConformanceList(Hasher& hasher, const TypeConformanceList& typeConformances)
+{
+    hasher.update(uint64_t(typeConformances.size()));
+    for (const auto& conformance : typeConformances)
+    {
+        hasher.update(conformance.first.typeName);
+        hasher.update(conformance.first.interfaceName);
+        hasher.update(conformance.second);
+    }
+}
+
 // FALCOR_ENUM_CLASS_OPERATORS(SlangCompilerFlags);
 //
 /**
@@ -263,6 +282,10 @@ struct ProgramDesc
     /// List of compiler arguments (as set on the compiler command line).
     std::vector<std::string> compilerArguments;
 
+    /// Linking style of the entry points.
+    /// If not specified, the linking style of the program manager is used.
+    ProgramLinkingStyle linkingStyle{ProgramLinkingStyle::Default};
+
     /// Max trace recursion depth (only used for raytracing programs).
     uint32_t maxTraceRecursionDepth = uint32_t(-1);
 
@@ -389,6 +412,13 @@ struct ProgramDesc
         return *this;
     }
 
+    /// Set the linking style of the entry points.
+    ProgramDesc& setLinkingStyle(ProgramLinkingStyle style)
+    {
+        linkingStyle = style;
+        return *this;
+    }
+
     //
     // Compatibility functions
     //
@@ -609,9 +639,33 @@ public:
 
     /**
      * Get the API handle of the active program.
+     * Can be called from several threads. Threads requesting a version that is being compiled wait for it.
+     * The version is returned by value, other threads may activate another version at any time.
      * @return The active program version, or an exception is thrown on failure.
      */
-    const ref<const ProgramVersion>& getActiveVersion() const;
+    ref<const ProgramVersion> getActiveVersion() const;
+
+    /**
+     * Request the version for the current defines and type conformances without waiting for it.
+     * The version, its kernels and their code are compiled in the background (see
+     * `ProgramManager::requestProgramVersion()`). Until the version is ready, `getServedVersion()`
+     * keeps returning the last version that compiled successfully.
+     * @return Handle that becomes ready when the version is compiled. It holds nullptr if compiling failed.
+     */
+    std::shared_future<ref<const ProgramVersion>> requestActiveVersion() const;
+
+    /**
+     * Get the version to use now, without waiting for a compile. If the version of the last
+     * `requestActiveVersion()` call is ready, it is swapped in first.
+     * @return The last version that compiled successfully, or nullptr if none did yet.
+     */
+    ref<const ProgramVersion> getServedVersion() const;
+
+    /**
+     * Get the time from the last `requestActiveVersion()` call to the swap of its version, in seconds.
+     * Zero if no requested version was swapped in yet.
+     */
+    double getLastSwapTime() const;
 
     /**
      * Adds a macro definition to the program. If the macro already exists, it will be replaced.
@@ -695,13 +749,20 @@ public:
      */
     const DefineList& getDefineList() const { return mDefineList; }
 
+    /**
+     * Get the fingerprint of the current macro definitions and type conformances.
+     * The fingerprint identifies the program version that is active for them. It is maintained
+     * incrementally as defines and type conformances change, and is stable across runs.
+     */
+    Hash128 getVersionFingerprint() const;
+
     const ProgramDesc& getDesc() const { return mDesc; }
 
     /**
      * Get the program reflection for the active program.
      * @return Program reflection object, or an exception is thrown on failure.
      */
-    const ref<const ProgramReflection>& getReflector() const { return getActiveVersion()->getReflector(); }
+    ref<const ProgramReflection> getReflector() const { return getActiveVersion()->getReflector(); }
 
     uint32_t getEntryPointGroupCount() const { return uint32_t(mDesc.entryPointGroups.size()); }
     uint32_t getGroupEntryPointCount(uint32_t groupIndex) const { return (uint32_t)mDesc.entryPointGroups[groupIndex].entryPoints.size(); }
@@ -717,8 +778,65 @@ protected:
     friend class ProgramVersion;
     friend class ParameterBlockReflection;
 
+    /**
+     * Create a program that is not registered with the program manager for reloading.
+     * Used for copies of a program that compile one of its permutations in the background.
+     */
+    Program(ref<Device> pDevice, ProgramDesc desc, DefineList programDefines, bool registerForReload);
+
     void validateEntryPoints() const;
-    bool link() const;
+
+    /**
+     * Compile the version for the current defines and type conformances and make it the active version.
+     * @param[out] pLog If not null, errors and warnings are appended to the log and false is
+     * returned on failure. Otherwise they are printed, and compiling is retried on failure.
+     * @param[in] slangContext Slang context to compile with (see `ProgramManager::createProgramVersion()`).
+     */
+    bool link(std::string* pLog = nullptr, uint32_t slangContext = 0) const;
+
+    /**
+     * Make the version for the current defines and type conformances the active version,
+     * compiling it if needed. Must be called with mVersionMutex held.
+     * @return False if compiling failed, which only happens if `pLog` is not null (see `link()`).
+     */
+    bool updateActiveVersion(std::string* pLog, uint32_t slangContext) const;
+
+    /**
+     * Make the version for the current defines and type conformances the active version if it is
+     * compiled already, without compiling it. Must be called with mVersionMutex held.
+     * @param[in] runPrecompile If true, a pending background compile of the version is run or waited
+     * for (see `ProgramManager::takePrecompiledVersion()`). Otherwise only a finished one is taken.
+     * @return False if the version isn't compiled or its background compile failed.
+     */
+    bool swapInVersion(bool runPrecompile) const;
+
+    /**
+     * Make a compiled version the active and served version. Must be called with mVersionMutex held.
+     * The version is accounted for the version budget by the next `touchActiveVersion()` call, so that
+     * swapping in a version from `getServedVersion()` doesn't measure versions or release them.
+     */
+    void setActiveVersion(const Hash128& fingerprint, const ref<const ProgramVersion>& pVersion) const;
+
+    /**
+     * Mark the active version as used for the version budget if it wasn't since it was activated
+     * (see `ProgramManager::touchProgramVersion()`). Must be called with mVersionMutex held.
+     */
+    void touchActiveVersion() const;
+
+    /**
+     * Wait for the background compile of the version for the current defines and type
+     * conformances, if there is one, with mVersionMutex released. Workers of the task scheduler
+     * don't wait, since the compile may be queued behind them; `updateActiveVersion()` compiles
+     * the version instead. Must be called with `lock` holding mVersionMutex.
+     */
+    void waitForPrecompiledVersion(std::unique_lock<std::mutex>& lock) const;
+
+    /**
+     * Get the active version like `getActiveVersion()`, but return errors in a log instead of
+     * printing them. Used by `ProgramManager::compileBatch()`.
+     * @return The active version, or nullptr if compiling failed.
+     */
+    ref<const ProgramVersion> activateVersion(std::string& log, uint32_t slangContext) const;
 
     BreakableReference<Device> mpDevice;
 
@@ -729,28 +847,44 @@ protected:
     DefineList mDefineList;
     TypeConformanceList mTypeConformanceList;
 
-    struct ProgramVersionKey
-    {
-        DefineList defineList;
-        TypeConformanceList typeConformanceList;
+    /// Hashes of mDefineList and mTypeConformanceList, updated whenever an entry is added or removed.
+    MultisetHash mDefineListHash;
+    MultisetHash mTypeConformanceListHash;
 
-        bool operator<(const ProgramVersionKey& rhs) const
-        {
-            return std::tie(defineList, typeConformanceList) < std::tie(rhs.defineList, rhs.typeConformanceList);
-        }
-    };
+    void rehashDefineList();
+    void rehashTypeConformanceList();
 
     // We are doing lazy compilation, so these are mutable
+    /// Guards the lazily compiled state below and mFileDependencies.
+    mutable std::mutex mVersionMutex;
     mutable bool mLinkRequired = true;
-    mutable std::map<ProgramVersionKey, ref<const ProgramVersion>> mProgramVersions;
+    /// Program versions keyed by their fingerprint (see getVersionFingerprint()).
+    mutable std::unordered_map<Hash128, ref<const ProgramVersion>, Hash128::HashFunction> mProgramVersions;
+    /// Program versions being compiled in the background, keyed by their fingerprint.
+    mutable std::unordered_map<Hash128, std::shared_future<ref<const ProgramVersion>>, Hash128::HashFunction> mPrecompiledVersions;
+    bool mRegisteredForReload = true;
     mutable ref<const ProgramVersion> mpActiveVersion;
+    mutable bool mTouchPending = false; ///< The active version wasn't marked as used since it was activated.
     void markDirty() { mLinkRequired = true; }
 
+    /// Version requested with requestActiveVersion() that wasn't swapped in yet.
+    mutable bool mVersionRequested = false;
+    mutable Hash128 mRequestedFingerprint;
+    mutable CpuTimer::TimePoint mRequestTime;
+
+    /// Guards the served version and swap time, which are read without waiting for compiles.
+    mutable std::mutex mServedVersionMutex;
+    mutable ref<const ProgramVersion> mpServedVersion; ///< Last version that compiled successfully.
+    mutable double mLastSwapTime = 0.0;
+
     std::string getProgramDescString() const;
 
-    using string_time_map = std::unordered_map<std::string, time_t>;
-    mutable string_time_map mFileTimeMap;
+    /// Source files of all program versions, with their state at the time they were compiled.
+    mutable std::unordered_map<std::string, ShaderFileDependency> mFileDependencies;
 
+    /**
+     * Check if any source file of the program changed since it was compiled.
+     */
     bool checkIfFilesChanged();
     void reset();
 };
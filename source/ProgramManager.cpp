@@ -10,8 +10,16 @@
 #include <algorithm>
 #include "ProgramManager.h"
 #include "CpuTimer.h"
+#include "DependencyTrackingFileSystem.h"
+#include "PermutationManifest.h"
+#include "ShaderCache.h"
+#include "SlangModuleCache.h"
+#include "TaskScheduler.h"
 #include "Utility.h"
 
+/// Bump when the way shader cache keys are computed changes.
+static const uint32_t kShaderCacheKeyVersion = 5;
+
 inline bool doSlangReflection(
     const ProgramVersion& programVersion,
     slang::IComponentType* pSlangGlobalScope,
@@ -38,40 +46,297 @@ inline bool doSlangReflection(
 }
 
 
-ProgramManager::ProgramManager(Device* pDevice) : mpDevice(pDevice)
+static void hashDefineList(Hasher& hasher, const DefineList& defineList)
+{
+    hasher.update(uint64_t(defineList.size()));
+    for (const auto& define : defineList)
+    {
+        hasher.update(define.first);
+        hasher.update(define.second);
+    }
+}
+
+/**
+ * Compute the shader cache key of the code of a single kernel.
+ */
+static Hash128 computeKernelCacheKey(
+    const Hash128& versionKey,
+    const TypeConformanceList& typeConformances,
+    const ProgramDesc::EntryPoint& entryPoint,
+    ProgramLinkingStyle linkingStyle
+)
+{
+    Hasher hasher;
+    hasher.update(versionKey);
+    hasher.update(linkingStyle);
+    hashTypeConformanceList(hasher, typeConformances);
+    hasher.update(entryPoint.globalIndex);
+    hasher.update(entryPoint.type);
+    hasher.update(entryPoint.exportName);
+    return hasher.getDigest();
+}
+
+/**
+ * Compute the shader cache key of a program version from its lookup key and the exact
+ * set of source files it was compiled from.
+ */
+static Hash128 computeProgramVersionCacheKey(const Hash128& lookupKey, const ShaderFileDependencyList& dependencies)
+{
+    Hasher hasher;
+    hasher.update(lookupKey);
+    hasher.update(uint64_t(dependencies.size()));
+    for (const auto& dependency : dependencies)
+    {
+        hasher.update(dependency.path);
+        hasher.update(dependency.contentHash);
+    }
+    return hasher.getDigest();
+}
+
+/**
+ * Compute a key identifying the translation units of a program.
+ * File contents are not hashed, the key is used to look up the modules a program imports,
+ * which are validated separately.
+ * @param[out] paths Full paths of the translation unit source files.
+ */
+static Hash128 computeTranslationUnitsKey(const ProgramDesc& desc, std::set<std::string>& paths)
+{
+    Hasher hasher;
+    hasher.update(uint64_t(desc.shaderModules.size()));
+    for (const auto& module : desc.shaderModules)
+    {
+        hasher.update(module.name);
+        hasher.update(uint64_t(module.sources.size()));
+        for (const auto& source : module.sources)
+        {
+            hasher.update(source.type);
+            if (source.type == ProgramDesc::ShaderSource::Type::File)
+            {
+                std::filesystem::path fullPath;
+                if (findFileInShaderDirectories(source.path, fullPath))
+                {
+                    paths.insert(fullPath.string());
+                    hasher.update(fullPath.string());
+                }
+                else
+                {
+                    hasher.update(source.path.string());
+                }
+            }
+            else
+            {
+                hasher.update(source.path.string());
+                hasher.update(source.string);
+            }
+        }
+    }
+    return hasher.getDigest();
+}
+
+/**
+ * Compute a key identifying a program description: its translation units, entry points and
+ * compile settings. Used to match programs against entries of the permutation manifest.
+ */
+static Hash128 computeProgramDescKey(const ProgramDesc& desc)
+{
+    Hasher hasher;
+    std::set<std::string> translationUnitPaths;
+    hasher.update(computeTranslationUnitsKey(desc, translationUnitPaths));
+
+    hasher.update(uint64_t(desc.entryPointGroups.size()));
+    for (const auto& entryPointGroup : desc.entryPointGroups)
+    {
+        hasher.update(entryPointGroup.shaderModuleIndex);
+        hashTypeConformanceList(hasher, entryPointGroup.typeConformances);
+        hasher.update(uint64_t(entryPointGroup.entryPoints.size()));
+        for (const auto& entryPoint : entryPointGroup.entryPoints)
+        {
+            hasher.update(entryPoint.type);
+            hasher.update(entryPoint.name);
+            hasher.update(entryPoint.exportName);
+        }
+    }
+
+    hasher.update(desc.shaderModel);
+    hasher.update(desc.compilerFlags);
+    hasher.update(uint64_t(desc.compilerArguments.size()));
+    for (const auto& arg : desc.compilerArguments)
+        hasher.update(arg);
+    return hasher.getDigest();
+}
+
+/**
+ * Compute the key of a permutation of a program: its description key and version fingerprint.
+ * Precompiles of programs with the same description and permutation are shared.
+ */
+static Hash128 computePermutationKey(const Program& program)
+{
+    Hasher hasher;
+    hasher.update(computeProgramDescKey(program.getDesc()));
+    hasher.update(program.getVersionFingerprint());
+    return hasher.getDigest();
+}
+
+/**
+ * Compute the key of a session configuration for the session pool.
+ * Covers everything that is fixed when a session is created, plus the compile request
+ * settings that are applied to the session's linkage.
+ */
+static Hash128 computeSessionPoolKey(const slang::SessionDesc& sessionDesc, const std::vector<const char*>& compilerArgs, bool debugInfo)
+{
+    Hasher hasher;
+    hasher.update(uint64_t(sessionDesc.searchPathCount));
+    for (SlangInt i = 0; i < sessionDesc.searchPathCount; ++i)
+        hasher.update(sessionDesc.searchPaths[i]);
+    hasher.update(uint64_t(sessionDesc.targetCount));
+    for (SlangInt i = 0; i < sessionDesc.targetCount; ++i)
+    {
+        const slang::TargetDesc& targetDesc = sessionDesc.targets[i];
+        hasher.update(targetDesc.format);
+        hasher.update(targetDesc.profile);
+        hasher.update(targetDesc.flags);
+        hasher.update(targetDesc.floatingPointMode);
+        hasher.update(targetDesc.forceGLSLScalarBufferLayout);
+    }
+    hasher.update(sessionDesc.defaultMatrixLayoutMode);
+    hasher.update(uint64_t(sessionDesc.preprocessorMacroCount));
+    for (SlangInt i = 0; i < sessionDesc.preprocessorMacroCount; ++i)
+    {
+        hasher.update(sessionDesc.preprocessorMacros[i].name);
+        hasher.update(sessionDesc.preprocessorMacros[i].value);
+    }
+    hasher.update(uint64_t(sessionDesc.compilerOptionEntryCount));
+    for (uint32_t i = 0; i < sessionDesc.compilerOptionEntryCount; ++i)
+    {
+        const slang::CompilerOptionEntry& entry = sessionDesc.compilerOptionEntries[i];
+        hasher.update(entry.name);
+        hasher.update(entry.value.kind);
+        hasher.update(entry.value.intValue0);
+        hasher.update(entry.value.intValue1);
+        hasher.update(entry.value.stringValue0 ? entry.value.stringValue0 : "");
+        hasher.update(entry.value.stringValue1 ? entry.value.stringValue1 : "");
+    }
+    hasher.update(uint64_t(compilerArgs.size()));
+    for (const char* arg : compilerArgs)
+        hasher.update(arg);
+    hasher.update(debugInfo);
+    return hasher.getDigest();
+}
+
+ProgramManager::ProgramManager(Device* pDevice) : mpDevice(pDevice), mpFileSystem(new DependencyTrackingFileSystem())
 {
+    // Context 0 uses the global session of the device, workers get one context each.
+    const uint32_t contextCount = 1 + pDevice->getTaskScheduler()->getWorkerCount();
+    for (uint32_t i = 0; i < contextCount; i++)
+        mSlangContexts.push_back(std::make_unique<SlangContext>());
+    mSlangContexts[0]->pGlobalSession = pDevice->getSlangGlobalSession();
+}
+
+ProgramManager::~ProgramManager()
+{
+    cancelPrecompile();
+
+    // Jobs submitted for cancelled precompiles still run, and must not find the program manager gone.
+    std::unique_lock<std::mutex> lock(mPrecompileMutex);
+    mPrecompileCondition.wait(lock, [this] { return mPrecompileJobs == 0; });
+}
+
+ref<const ProgramVersion> ProgramManager::createProgramVersion(const Program& program, std::string& log, uint32_t slangContext) const
+{
+    SlangContext& context = getSlangContext(slangContext);
+    std::lock_guard<std::mutex> lock(context.mutex);
+    ref<const ProgramVersion> pVersion = createProgramVersionImpl(program, slangContext, log);
+    if (pVersion)
+        recordPermutation(program);
+    return pVersion;
 }
 
-ref<const ProgramVersion> ProgramManager::createProgramVersion(const Program& program, std::string& log) const
+ref<const ProgramVersion> ProgramManager::createProgramVersionImpl(const Program& program, uint32_t slangContext, std::string& log) const
 {
+    SlangContext& context = getSlangContext(slangContext);
+
     CpuTimer timer;
     timer.update();
 
-    auto pSlangRequest = createSlangCompileRequest(program);
-    if (pSlangRequest == nullptr)
+    Hash128 lookupKey;
+    Hash128 cacheKey;
+    ShaderFileDependencyList dependencies;
+    if (mpShaderCache)
+    {
+        // The cache key depends on the exact source files of the version. These are only known
+        // after compiling, so we use the dependency manifest stored by the last compile.
+        lookupKey = computeProgramVersionLookupKey(program);
+        if (loadDependencyManifest(lookupKey, dependencies))
+            cacheKey = computeProgramVersionCacheKey(lookupKey, dependencies);
+
+        // If the code of all kernels is available, we can skip the Slang front-end entirely.
+        // The version is created without Slang objects and with an empty reflection.
+        bool allKernelsCached = mShaderCacheDesc.skipFrontEndOnHit && !cacheKey.isZero();
+        const ProgramLinkingStyle linkingStyle = getLinkingStyle(program);
+        for (const auto& entryPointGroup : program.mDesc.entryPointGroups)
+        {
+            TypeConformanceList typeConformances = program.mTypeConformanceList;
+            typeConformances.add(entryPointGroup.typeConformances);
+            for (const auto& entryPoint : entryPointGroup.entryPoints)
+            {
+                Hash128 kernelCacheKey = computeKernelCacheKey(cacheKey, typeConformances, entryPoint, linkingStyle);
+                for (uint32_t targetIndex = 0; allKernelsCached && targetIndex < getTargetCount(); targetIndex++)
+                    allKernelsCached = mpShaderCache->contains(EntryPointKernel::computeTargetCacheKey(kernelCacheKey, targetIndex));
+            }
+        }
+
+        if (allKernelsCached)
+        {
+            ref<ProgramVersion> pVersion = ProgramVersion::createEmpty(const_cast<Program*>(&program), nullptr);
+            ref<const ProgramReflection> pReflector = ProgramReflection::create(pVersion.get(), nullptr, {}, log);
+            pVersion->init(program.getDefineList(), pReflector, program.getProgramDescString(), {});
+            pVersion->mCacheKey = cacheKey;
+            pVersion->mFileDependencies = std::move(dependencies);
+            pVersion->mSlangContext = slangContext;
+            for (const auto& dependency : pVersion->mFileDependencies)
+                program.mFileDependencies[dependency.path] = dependency;
+
+            timer.update();
+            recordProgramVersionTime(timer.delta(), true);
+
+            return pVersion;
+        }
+    }
+
+    FrontEndResult frontEnd;
+    bool frontEndSucceeded = mUseCompileRequest || !canUseSessionFrontEnd(program)
+                                 ? runFrontEndWithCompileRequest(program, context, frontEnd, log)
+                                 : runFrontEndWithSession(program, context, frontEnd, log);
+    if (!frontEndSucceeded)
         return nullptr;
 
-    SlangResult slangResult = spCompile(pSlangRequest);
-    log += spGetDiagnosticOutput(pSlangRequest);
-    if (SLANG_FAILED(slangResult))
+    Slang::ComPtr<slang::IComponentType> pSlangGlobalScope = frontEnd.pSlangGlobalScope;
+
+    dependencies.clear();
+    collectFileDependencies(frontEnd.dependencyPaths, dependencies);
+    if (mpShaderCache)
     {
-        spDestroyCompileRequest(pSlangRequest);
-        return nullptr;
+        cacheKey = computeProgramVersionCacheKey(lookupKey, dependencies);
+        storeDependencyManifest(lookupKey, dependencies);
     }
 
-    Slang::ComPtr<slang::IComponentType> pSlangGlobalScope;
-    spCompileRequest_getProgram(pSlangRequest, pSlangGlobalScope.writeRef());
-
     Slang::ComPtr<slang::ISession> pSlangSession(pSlangGlobalScope->getSession());
 
+    if (mpModuleCache)
+    {
+        std::set<std::string> translationUnitPaths;
+        Hash128 programKey = computeTranslationUnitsKey(program.mDesc, translationUnitPaths);
+        std::lock_guard<std::mutex> cacheLock(mCacheMutex);
+        mpModuleCache->storeModules(pSlangSession, computeSessionCacheKey(program), programKey, getSessionDefines(program), translationUnitPaths);
+    }
+
     // Prepare entry points.
     std::vector<Slang::ComPtr<slang::IComponentType>> pSlangEntryPoints;
     for (const auto& entryPointGroup : program.mDesc.entryPointGroups)
     {
         for (const auto& entryPoint : entryPointGroup.entryPoints)
         {
-            Slang::ComPtr<slang::IComponentType> pSlangEntryPoint;
-            spCompileRequest_getEntryPoint(pSlangRequest, entryPoint.globalIndex, pSlangEntryPoint.writeRef());
+            Slang::ComPtr<slang::IComponentType> pSlangEntryPoint = frontEnd.pSlangEntryPoints[entryPoint.globalIndex];
 
             // Rename entry point in the generated code if the exported name differs from the source name.
             // This makes it possible to generate different specializations of the same source entry point,
@@ -102,19 +367,6 @@ ref<const ProgramVersion> ProgramManager::createProgramVersion(const Program& pr
     // TODO @skallweit remove const cast
     ref<ProgramVersion> pVersion = ProgramVersion::createEmpty(const_cast<Program*>(&program), pSlangGlobalScope);
 
-    // Note: Because of interactions between how `SV_Target` outputs
-    // and `u` register bindings work in Slang today (as a compatibility
-    // feature for Shader Model 5.0 and below), we need to make sure
-    // that the entry points are included in the component type we use
-    // for reflection.
-    //
-    // TODO: Once Slang drops that behavior for SM 5.1+, we should be able
-    // to just use `pSlangGlobalScope` for the reflection step instead
-    // of `pSlangProgram`.
-    //
-    Slang::ComPtr<slang::IComponentType> pSlangProgram;
-    spCompileRequest_getProgram(pSlangRequest, pSlangProgram.writeRef());
-
     ref<const ProgramReflection> pReflector;
     if (!doSlangReflection(*pVersion, pSlangGlobalScope, pSlangEntryPoints, pReflector, log))
     {
@@ -123,12 +375,14 @@ ref<const ProgramVersion> ProgramManager::createProgramVersion(const Program& pr
 
     auto descStr = program.getProgramDescString();
     pVersion->init(program.getDefineList(), pReflector, descStr, pSlangEntryPoints);
+    pVersion->mCacheKey = cacheKey;
+    pVersion->mFileDependencies = std::move(dependencies);
+    pVersion->mSlangContext = slangContext;
+    for (const auto& dependency : pVersion->mFileDependencies)
+        program.mFileDependencies[dependency.path] = dependency;
 
     timer.update();
-    double time = timer.delta();
-    mCompilationStats.programVersionCount++;
-    mCompilationStats.programVersionTotalTime += time;
-    mCompilationStats.programVersionMaxTime = std::max(mCompilationStats.programVersionMaxTime, time);
+    recordProgramVersionTime(timer.delta(), false);
 
     return pVersion;
 }
@@ -136,85 +390,30 @@ ref<const ProgramVersion> ProgramManager::createProgramVersion(const Program& pr
 ref<const ProgramKernels> ProgramManager::createProgramKernels(
     const Program& program,
     const ProgramVersion& programVersion,
+    const TypeConformanceList& globalTypeConformances,
     std::string& log
 ) const
 {
+    SlangContext& context = getSlangContext(programVersion.mSlangContext);
+    std::lock_guard<std::mutex> lock(context.mutex);
+
     CpuTimer timer;
     timer.update();
 
-    auto pSlangGlobalScope = programVersion.getSlangGlobalScope();
-    auto pSlangSession = pSlangGlobalScope->getSession();
-
-    slang::IComponentType* pSpecializedSlangGlobalScope = pSlangGlobalScope;
-
-    // Create a composite component type that represents all type conformances
-    // linked into the `ProgramVersion`.
-    auto createTypeConformanceComponentList = [&](const TypeConformanceList& typeConformances
-                                              ) -> std::optional<Slang::ComPtr<slang::IComponentType>>
+    if (programVersion.isCacheBacked())
     {
-        Slang::ComPtr<slang::IComponentType> pTypeConformancesCompositeComponent;
-        std::vector<Slang::ComPtr<slang::ITypeConformance>> typeConformanceComponentList;
-        std::vector<slang::IComponentType*> typeConformanceComponentRawPtrList;
+        ref<const ProgramKernels> pProgramKernels = createCacheBackedProgramKernels(program, programVersion, globalTypeConformances);
 
-        for (auto& typeConformance : typeConformances)
-        {
-            Slang::ComPtr<slang::IBlob> pSlangDiagnostics;
-            Slang::ComPtr<slang::ITypeConformance> pTypeConformanceComponent;
+        timer.update();
+        recordProgramKernelsTime(timer.delta());
 
-            // Look for the type and interface type specified by the type conformance.
-            // If not found we'll log an error and return.
-            auto slangType = pSlangGlobalScope->getLayout()->findTypeByName(typeConformance.first.typeName.c_str());
-            auto slangInterfaceType = pSlangGlobalScope->getLayout()->findTypeByName(typeConformance.first.interfaceName.c_str());
-            if (!slangType)
-            {
-                log += std::string("Type ") + typeConformance.first.typeName + std::string(" in type conformance was not found.\n");
-                return {};
-            }
-            if (!slangInterfaceType)
-            {
-                log += std::string("Interface type ") + typeConformance.first.interfaceName + std::string(" in type conformance was not found.\n");
-                return {};
-            }
+        return pProgramKernels;
+    }
 
-            auto res = pSlangSession->createTypeConformanceComponentType(
-                slangType,
-                slangInterfaceType,
-                pTypeConformanceComponent.writeRef(),
-                (SlangInt)typeConformance.second,
-                pSlangDiagnostics.writeRef()
-            );
-            if (SLANG_FAILED(res))
-            {
-                log += "Slang call createTypeConformanceComponentType() failed.\n";
-                return {};
-            }
-            if (pSlangDiagnostics && pSlangDiagnostics->getBufferSize() > 0)
-            {
-                log += (char const*)pSlangDiagnostics->getBufferPointer();
-            }
-            if (pTypeConformanceComponent)
-            {
-                typeConformanceComponentList.push_back(pTypeConformanceComponent);
-                typeConformanceComponentRawPtrList.push_back(pTypeConformanceComponent.get());
-            }
-        }
-        if (!typeConformanceComponentList.empty())
-        {
-            Slang::ComPtr<slang::IBlob> pSlangDiagnostics;
-            auto res = pSlangSession->createCompositeComponentType(
-                &typeConformanceComponentRawPtrList[0],
-                (SlangInt)typeConformanceComponentRawPtrList.size(),
-                pTypeConformancesCompositeComponent.writeRef(),
-                pSlangDiagnostics.writeRef()
-            );
-            if (SLANG_FAILED(res))
-            {
-                log += "Slang call createCompositeComponentType() failed.\n";
-                return {};
-            }
-        }
-        return pTypeConformancesCompositeComponent;
-    };
+    auto pSlangGlobalScope = programVersion.getSlangGlobalScope();
+    auto pSlangSession = pSlangGlobalScope->getSession();
+
+    slang::IComponentType* pSpecializedSlangGlobalScope = pSlangGlobalScope;
 
     // Create one composite component type for the type conformances of each entry point group.
     // The type conformances for each group is the combination of the global and group type conformances.
@@ -222,20 +421,29 @@ ref<const ProgramKernels> ProgramManager::createProgramKernels(
     typeConformancesCompositeComponents.reserve(program.mDesc.entryPointGroups.size());
     for (const auto& group : program.mDesc.entryPointGroups)
     {
-        TypeConformanceList typeConformances = program.mTypeConformanceList;
+        TypeConformanceList typeConformances = globalTypeConformances;
         typeConformances.add(group.typeConformances);
-        if (auto typeConformanceComponentList = createTypeConformanceComponentList(typeConformances))
+        if (auto typeConformanceComponentList = getTypeConformanceComposite(context, pSlangGlobalScope, typeConformances, log))
             typeConformancesCompositeComponents.emplace_back(*typeConformanceComponentList);
         else
             return nullptr;
     }
 
+    // With whole-program linking, all kernels generate their code from the composed program.
+    const ProgramLinkingStyle linkingStyle = getLinkingStyle(program);
+    const bool wholeProgram = linkingStyle == ProgramLinkingStyle::WholeProgram;
+
+    // Kernels that only carry code need either the linked entry points or the composed
+    // program to generate their code, and no reflection or gfx program.
+    const bool needLinkedEntryPoints = !mKernelCodeOnly || !wholeProgram;
+    const bool needProgram = !mKernelCodeOnly || wholeProgram;
+
     std::vector<Slang::ComPtr<slang::IComponentType>> pTypeConformanceSpecializedEntryPoints;
     std::vector<slang::IComponentType*> pTypeConformanceSpecializedEntryPointsRawPtr;
     std::vector<Slang::ComPtr<slang::IComponentType>> pLinkedEntryPoints;
 
     // Create a `IComponentType` for each entry point.
-    for (size_t groupIndex = 0; groupIndex < program.mDesc.entryPointGroups.size(); ++groupIndex)
+    for (size_t groupIndex = 0; needLinkedEntryPoints && groupIndex < program.mDesc.entryPointGroups.size(); ++groupIndex)
     {
         const auto& entryPointGroup = program.mDesc.entryPointGroups[groupIndex];
 
@@ -318,6 +526,7 @@ ref<const ProgramKernels> ProgramManager::createProgramKernels(
     // support for SM5.0 and below.
     //
     Slang::ComPtr<slang::IComponentType> pSpecializedSlangProgram;
+    if (needProgram)
     {
         // We are going to compose the global scope (specialized) with
         // all the entry points. Note that we do *not* use the "linked"
@@ -355,17 +564,37 @@ ref<const ProgramKernels> ProgramManager::createProgramKernels(
         }
     }
 
-    ref<const ProgramReflection> pReflector;
-    doSlangReflection(programVersion, pSpecializedSlangProgram, pLinkedEntryPoints, pReflector, log);
+    // Kernels that only carry code use the reflection of the unspecialized program.
+    ref<const ProgramReflection> pReflector = programVersion.getReflector();
+    if (!mKernelCodeOnly)
+        doSlangReflection(programVersion, pSpecializedSlangProgram, pLinkedEntryPoints, pReflector, log);
+
+    // Kernel code is only cached if the shader cache was enabled when the version was created.
+    const bool useShaderCache = !programVersion.getCacheKey().isZero() && mpShaderCache;
 
     // Create kernel objects for each entry point and cache them here.
     std::vector<ref<EntryPointKernel>> allKernels;
     for (const auto& entryPointGroup : program.mDesc.entryPointGroups)
     {
+        TypeConformanceList typeConformances = globalTypeConformances;
+        typeConformances.add(entryPointGroup.typeConformances);
+
         for (const auto& entryPoint : entryPointGroup.entryPoints)
         {
-            auto pLinkedEntryPoint = pLinkedEntryPoints[entryPoint.globalIndex];
-            ref<EntryPointKernel> kernel = EntryPointKernel::create(pLinkedEntryPoint, entryPoint.type, entryPoint.exportName);
+            Hash128 kernelCacheKey;
+            if (useShaderCache)
+                kernelCacheKey = computeKernelCacheKey(programVersion.getCacheKey(), typeConformances, entryPoint, linkingStyle);
+            ref<EntryPointKernel> kernel = EntryPointKernel::create(
+                wholeProgram ? pSpecializedSlangProgram : pLinkedEntryPoints[entryPoint.globalIndex],
+                entryPoint.type,
+                entryPoint.exportName,
+                &mCodeBlobStore,
+                kernelCacheKey,
+                &context.mutex,
+                wholeProgram,
+                getTargetCount(),
+                getCodegenCallback()
+            );
             if (!kernel)
                 return nullptr;
 
@@ -402,26 +631,74 @@ ref<const ProgramKernels> ProgramManager::createProgramKernels(
     }
 
     auto descStr = program.getProgramDescString();
-    ref<const ProgramKernels> pProgramKernels = ProgramKernels::create(
-        mpDevice,
-        &programVersion,
-        pSpecializedSlangGlobalScope,
-        pTypeConformanceSpecializedEntryPointsRawPtr,
-        pReflector,
-        entryPointGroups,
-        log,
-        descStr
-    );
+    ref<const ProgramKernels> pProgramKernels;
+    if (mKernelCodeOnly)
+    {
+        pProgramKernels = ProgramKernels::createCodeOnly(&programVersion, pReflector, entryPointGroups, descStr);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> gfxLock(mGfxMutex);
+        pProgramKernels = ProgramKernels::create(
+            mpDevice,
+            &programVersion,
+            pSpecializedSlangGlobalScope,
+            pTypeConformanceSpecializedEntryPointsRawPtr,
+            pReflector,
+            entryPointGroups,
+            log,
+            descStr,
+            linkingStyle
+        );
+    }
 
     timer.update();
-    double time = timer.delta();
-    mCompilationStats.programKernelsCount++;
-    mCompilationStats.programKernelsTotalTime += time;
-    mCompilationStats.programKernelsMaxTime = std::max(mCompilationStats.programKernelsMaxTime, time);
+    recordProgramKernelsTime(timer.delta());
 
     return pProgramKernels;
 }
 
+ref<const ProgramKernels> ProgramManager::createCacheBackedProgramKernels(
+    const Program& program,
+    const ProgramVersion& programVersion,
+    const TypeConformanceList& globalTypeConformances
+) const
+{
+    ASSERT(mpShaderCache);
+
+    SlangContext& context = getSlangContext(programVersion.mSlangContext);
+    const ProgramLinkingStyle linkingStyle = getLinkingStyle(program);
+    std::vector<ref<const EntryPointGroupKernels>> entryPointGroups;
+    for (size_t groupIndex = 0; groupIndex < program.mDesc.entryPointGroups.size(); ++groupIndex)
+    {
+        const auto& entryPointGroup = program.mDesc.entryPointGroups[groupIndex];
+
+        TypeConformanceList typeConformances = globalTypeConformances;
+        typeConformances.add(entryPointGroup.typeConformances);
+
+        std::vector<ref<EntryPointKernel>> kernels;
+        for (const auto& entryPoint : entryPointGroup.entryPoints)
+        {
+            Hash128 kernelCacheKey = computeKernelCacheKey(programVersion.getCacheKey(), typeConformances, entryPoint, linkingStyle);
+            kernels.push_back(EntryPointKernel::create(
+                nullptr,
+                entryPoint.type,
+                entryPoint.exportName,
+                &mCodeBlobStore,
+                kernelCacheKey,
+                &context.mutex,
+                linkingStyle == ProgramLinkingStyle::WholeProgram,
+                getTargetCount(),
+                getCodegenCallback()
+            ));
+        }
+        auto pGroupReflector = programVersion.getReflector()->getEntryPointGroup(groupIndex);
+        entryPointGroups.push_back(createEntryPointGroupKernels(kernels, pGroupReflector));
+    }
+
+    return ProgramKernels::createCodeOnly(&programVersion, programVersion.getReflector(), entryPointGroups, program.getProgramDescString());
+}
+
 ref<const EntryPointGroupKernels> ProgramManager::createEntryPointGroupKernels(
     const std::vector<ref<EntryPointKernel>>& kernels,
     const ref<EntryPointBaseReflection>& pReflector
@@ -458,12 +735,28 @@ ref<const EntryPointGroupKernels> ProgramManager::createEntryPointGroupKernels(
 
 bool ProgramManager::reloadAllPrograms(bool forceReload)
 {
+    cancelPrecompile();
+
     bool hasReloaded = false;
+    bool filesChanged = mpFileSystem->hasChangedFiles();
 
+    std::lock_guard<std::mutex> lock(mLoadedProgramsMutex);
     for (auto program : mLoadedPrograms)
     {
-        program->reset();
-        hasReloaded = true;
+        bool programFilesChanged = program->checkIfFilesChanged();
+        filesChanged |= programFilesChanged;
+        if (forceReload || programFilesChanged)
+        {
+            program->reset();
+            hasReloaded = true;
+        }
+    }
+
+    // Pooled sessions hold on to modules loaded from the old sources.
+    if (filesChanged)
+    {
+        flushSessionPool();
+        mpFileSystem->clear();
     }
 
     return hasReloaded;
@@ -471,28 +764,176 @@ bool ProgramManager::reloadAllPrograms(bool forceReload)
 
 void ProgramManager::registerProgramForReload(Program* program)
 {
-    mLoadedPrograms.push_back(program);
+    {
+        std::lock_guard<std::mutex> lock(mLoadedProgramsMutex);
+        mLoadedPrograms.push_back(program);
+    }
+    // The program is still being constructed, so no other thread can use it yet.
+    schedulePrecompile(*program);
 }
 
 void ProgramManager::unregisterProgramForReload(Program* program)
 {
+    std::lock_guard<std::mutex> lock(mLoadedProgramsMutex);
     mLoadedPrograms.erase(std::remove(mLoadedPrograms.begin(), mLoadedPrograms.end(), program), mLoadedPrograms.end());
 }
 
-void ProgramManager::addGlobalDefines(const DefineList& defineList)
+ProgramManager::ReloadResult ProgramManager::reloadPrograms(const std::function<bool(Program&)>& needsReload)
+{
+    ReloadResult result;
+    std::lock_guard<std::mutex> lock(mLoadedProgramsMutex);
+    for (auto program : mLoadedPrograms)
+    {
+        bool reload;
+        {
+            std::lock_guard<std::mutex> versionLock(program->mVersionMutex);
+            reload = needsReload(*program);
+        }
+        if (reload)
+        {
+            program->reset();
+            result.rebuilt++;
+        }
+        else
+        {
+            result.kept++;
+        }
+    }
+    return result;
+}
+
+bool ProgramManager::mayReferenceMacros(const Program& program, const std::vector<std::string>& names) const
+{
+    // Nothing to invalidate if the program wasn't compiled yet.
+    if (program.mProgramVersions.empty())
+        return false;
+    if (program.mFileDependencies.empty())
+        return true;
+
+    // Slang doesn't report which macros the preprocessor queried. A macro can only be queried
+    // if its name appears as an identifier in one of the files, so we use that instead.
+    for (const auto& dependency : program.mFileDependencies)
+    {
+        auto pInfo = mFileInfoCache.get(dependency.first);
+        if (!pInfo)
+            return true;
+        for (const auto& name : names)
+        {
+            if (pInfo->mayReferenceMacro(name))
+                return true;
+        }
+    }
+    return false;
+}
+
+ProgramManager::ReloadResult ProgramManager::reloadProgramsReferencingGlobalDefines(const DefineList& oldGlobalDefineList)
+{
+    // Collect the macros that were added, removed or changed their value.
+    std::vector<std::string> changedNames;
+    for (const auto& define : oldGlobalDefineList)
+    {
+        auto it = mGlobalDefineList.find(define.first);
+        if (it == mGlobalDefineList.end() || it->second != define.second)
+            changedNames.push_back(define.first);
+    }
+    for (const auto& define : mGlobalDefineList)
+    {
+        if (oldGlobalDefineList.find(define.first) == oldGlobalDefineList.end())
+            changedNames.push_back(define.first);
+    }
+
+    return reloadPrograms(
+        [&](Program& program)
+        {
+            // Global defines are overridden by the program's own defines.
+            std::vector<std::string> names;
+            for (const auto& name : changedNames)
+            {
+                if (program.getDefineList().find(name) == program.getDefineList().end())
+                    names.push_back(name);
+            }
+            return !names.empty() && mayReferenceMacros(program, names);
+        }
+    );
+}
+
+ProgramManager::ReloadResult ProgramManager::addGlobalDefines(const DefineList& defineList)
 {
+    cancelPrecompile();
+    DefineList oldGlobalDefineList = mGlobalDefineList;
     mGlobalDefineList.add(defineList);
-    reloadAllPrograms(true);
+    return reloadProgramsReferencingGlobalDefines(oldGlobalDefineList);
 }
 
-void ProgramManager::removeGlobalDefines(const DefineList& defineList)
+ProgramManager::ReloadResult ProgramManager::removeGlobalDefines(const DefineList& defineList)
 {
+    cancelPrecompile();
+    DefineList oldGlobalDefineList = mGlobalDefineList;
     mGlobalDefineList.remove(defineList);
+    return reloadProgramsReferencingGlobalDefines(oldGlobalDefineList);
+}
+
+void ProgramManager::setSpirvDirectMode(bool enable)
+{
+    if (m_enableSpirvDirect == enable)
+        return;
+    cancelPrecompile();
+    m_enableSpirvDirect = enable;
     reloadAllPrograms(true);
 }
 
+void ProgramManager::setCompileRequestMode(bool enable)
+{
+    if (mUseCompileRequest == enable)
+        return;
+    cancelPrecompile();
+    mUseCompileRequest = enable;
+    reloadAllPrograms(true);
+}
+
+void ProgramManager::setAdditionalTargets(const std::vector<AdditionalTarget>& targets)
+{
+    auto isEqual = [](const AdditionalTarget& a, const AdditionalTarget& b) { return a.format == b.format && a.spirvDirect == b.spirvDirect; };
+    if (std::equal(targets.begin(), targets.end(), mAdditionalTargets.begin(), mAdditionalTargets.end(), isEqual))
+        return;
+    cancelPrecompile();
+    mAdditionalTargets = targets;
+    reloadAllPrograms(true);
+}
+
+void ProgramManager::setKernelCodeOnlyMode(bool enable)
+{
+    if (mKernelCodeOnly == enable)
+        return;
+    cancelPrecompile();
+    mKernelCodeOnly = enable;
+    reloadAllPrograms(true);
+}
+
+void ProgramManager::setLinkingStyle(ProgramLinkingStyle style)
+{
+    ASSERT(style != ProgramLinkingStyle::Default);
+    if (mLinkingStyle == style)
+        return;
+    cancelPrecompile();
+    mLinkingStyle = style;
+    reloadAllPrograms(true);
+}
+
+ProgramLinkingStyle ProgramManager::getLinkingStyle(const Program& program) const
+{
+    return program.mDesc.linkingStyle == ProgramLinkingStyle::Default ? mLinkingStyle : program.mDesc.linkingStyle;
+}
+
+void ProgramManager::setGlobalCompilerArguments(const std::vector<std::string>& args)
+{
+    cancelPrecompile();
+    mGlobalCompilerArguments = args;
+}
+
 void ProgramManager::setGenerateDebugInfoEnabled(bool enabled)
 {
+    cancelPrecompile();
     mGenerateDebugInfo = enabled;
 }
 
@@ -501,10 +942,17 @@ bool ProgramManager::isGenerateDebugInfoEnabled()
     return mGenerateDebugInfo;
 }
 
-void ProgramManager::setForcedCompilerFlags(ForcedCompilerFlags forcedCompilerFlags)
+ProgramManager::ReloadResult ProgramManager::setForcedCompilerFlags(ForcedCompilerFlags forcedCompilerFlags)
 {
+    cancelPrecompile();
+    ForcedCompilerFlags oldForcedCompilerFlags = mForcedCompilerFlags;
     mForcedCompilerFlags = forcedCompilerFlags;
-    reloadAllPrograms(true);
+
+    // Only programs whose effective flags change need to be compiled again.
+    return reloadPrograms(
+        [&](Program& program)
+        { return getCompilerFlags(program, oldForcedCompilerFlags) != getCompilerFlags(program, mForcedCompilerFlags); }
+    );
 }
 
 ProgramManager::ForcedCompilerFlags ProgramManager::getForcedCompilerFlags()
@@ -512,16 +960,890 @@ ProgramManager::ForcedCompilerFlags ProgramManager::getForcedCompilerFlags()
     return mForcedCompilerFlags;
 }
 
-SlangCompileRequest* ProgramManager::createSlangCompileRequest(const Program& program) const
+void ProgramManager::setModuleCache(const std::filesystem::path& directory)
 {
-    slang::IGlobalSession* pSlangGlobalSession = mpDevice->getSlangGlobalSession();
-    ASSERT(pSlangGlobalSession);
-
-    slang::SessionDesc sessionDesc;
+    cancelPrecompile();
+    if (directory.empty())
+        mpModuleCache.reset();
+    else
+        mpModuleCache = std::make_unique<SlangModuleCache>(directory);
+}
 
-    // Add our shader search paths as `#include` search paths for Slang.
-    //
-    // Note: Slang allows application to plug in a callback API to
+void ProgramManager::setSessionPoolSize(size_t size)
+{
+    cancelPrecompile();
+    mSessionPoolSize = size;
+    for (uint32_t i = 0; i < getSlangContextCount(); i++)
+    {
+        SlangContext& context = getSlangContext(i);
+        std::lock_guard<std::mutex> lock(context.mutex);
+        std::lock_guard<std::mutex> statsLock(mStatsMutex);
+        while (context.sessionPool.size() > mSessionPoolSize)
+        {
+            context.sessionPool.pop_back();
+            mCompilationStats.sessionPoolEvictions++;
+        }
+        while (context.typeConformanceCache.size() > std::max<size_t>(mSessionPoolSize, 1))
+            context.typeConformanceCache.pop_back();
+    }
+}
+
+Slang::ComPtr<slang::ISession> ProgramManager::acquireSession(SlangContext& context, const slang::SessionDesc& sessionDesc, const Hash128& key) const
+{
+    std::list<PooledSession>& sessionPool = context.sessionPool;
+    for (auto it = sessionPool.begin(); it != sessionPool.end(); ++it)
+    {
+        if (it->key == key)
+        {
+            sessionPool.splice(sessionPool.begin(), sessionPool, it);
+            std::lock_guard<std::mutex> statsLock(mStatsMutex);
+            mCompilationStats.sessionPoolHits++;
+            return sessionPool.front().pSession;
+        }
+    }
+
+    Slang::ComPtr<slang::ISession> pSlangSession;
+    context.pGlobalSession->createSession(sessionDesc, pSlangSession.writeRef());
+    std::lock_guard<std::mutex> statsLock(mStatsMutex);
+    mCompilationStats.sessionPoolMisses++;
+    if (!pSlangSession || mSessionPoolSize == 0)
+        return pSlangSession;
+
+    sessionPool.push_front({key, pSlangSession});
+    if (sessionPool.size() > mSessionPoolSize)
+    {
+        sessionPool.pop_back();
+        mCompilationStats.sessionPoolEvictions++;
+    }
+    return pSlangSession;
+}
+
+void ProgramManager::flushSessionPool()
+{
+    for (uint32_t i = 0; i < getSlangContextCount(); i++)
+    {
+        SlangContext& context = getSlangContext(i);
+        std::lock_guard<std::mutex> lock(context.mutex);
+        context.sessionPool.clear();
+        context.typeConformanceCache.clear();
+    }
+}
+
+uint32_t ProgramManager::getWorkerSlangContext() const
+{
+    const uint32_t workerIndex = mpDevice->getTaskScheduler()->getCurrentWorkerIndex();
+    if (workerIndex + 1 >= getSlangContextCount())
+        return 0;
+
+    SlangContext& context = getSlangContext(workerIndex + 1);
+    std::lock_guard<std::mutex> lock(context.mutex);
+    if (!context.pGlobalSession)
+        context.pGlobalSession = mpDevice->createSlangGlobalSession();
+    return workerIndex + 1;
+}
+
+std::optional<Slang::ComPtr<slang::IComponentType>> ProgramManager::getTypeConformanceComposite(
+    SlangContext& context,
+    slang::IComponentType* pSlangGlobalScope,
+    const TypeConformanceList& typeConformances,
+    std::string& log
+) const
+{
+    slang::ISession* pSlangSession = pSlangGlobalScope->getSession();
+
+    // Find the cached conformances of the session.
+    std::list<SessionTypeConformances>& typeConformanceCache = context.typeConformanceCache;
+    auto sessionIt = typeConformanceCache.begin();
+    while (sessionIt != typeConformanceCache.end() && sessionIt->pSession != pSlangSession)
+        ++sessionIt;
+    if (sessionIt == typeConformanceCache.end())
+    {
+        SessionTypeConformances entry;
+        entry.pSession = pSlangSession;
+        typeConformanceCache.push_front(std::move(entry));
+        if (typeConformanceCache.size() > std::max<size_t>(mSessionPoolSize, 1))
+            typeConformanceCache.pop_back();
+    }
+    else
+    {
+        typeConformanceCache.splice(typeConformanceCache.begin(), typeConformanceCache, sessionIt);
+    }
+    SessionTypeConformances& cache = typeConformanceCache.front();
+
+    // Names resolve to the same types within a global scope.
+    if (cache.pGlobalScope.get() != pSlangGlobalScope)
+    {
+        cache.pGlobalScope = pSlangGlobalScope;
+        cache.globalScopeComposites.clear();
+    }
+    Hasher nameHasher;
+    hashTypeConformanceList(nameHasher, typeConformances);
+    const Hash128 nameKey = nameHasher.getDigest();
+    auto globalScopeIt = cache.globalScopeComposites.find(nameKey);
+    if (globalScopeIt != cache.globalScopeComposites.end())
+    {
+        std::lock_guard<std::mutex> statsLock(mStatsMutex);
+        mCompilationStats.typeConformanceCacheHits++;
+        return globalScopeIt->second;
+    }
+
+    // Pooled sessions are shared by programs with different modules, so the types are always looked
+    // up in the global scope of the calling program: a name may be missing there, or resolve to a
+    // type of another module. Types are unique within a session, so the cache is keyed by the types
+    // found rather than by their names.
+    struct ResolvedConformance
+    {
+        slang::TypeReflection* pType;
+        slang::TypeReflection* pInterfaceType;
+        uint32_t id;
+    };
+    std::vector<ResolvedConformance> resolvedConformances;
+    slang::ProgramLayout* pLayout = typeConformances.empty() ? nullptr : pSlangGlobalScope->getLayout();
+    for (auto& typeConformance : typeConformances)
+    {
+        // Look for the type and interface type specified by the type conformance.
+        // If not found we'll log an error and return.
+        auto slangType = pLayout->findTypeByName(typeConformance.first.typeName.c_str());
+        auto slangInterfaceType = pLayout->findTypeByName(typeConformance.first.interfaceName.c_str());
+        if (!slangType)
+        {
+            log += std::string("Type ") + typeConformance.first.typeName + std::string(" in type conformance was not found.\n");
+            return {};
+        }
+        if (!slangInterfaceType)
+        {
+            log += std::string("Interface type ") + typeConformance.first.interfaceName + std::string(" in type conformance was not found.\n");
+            return {};
+        }
+        resolvedConformances.push_back({slangType, slangInterfaceType, typeConformance.second});
+    }
+
+    // The list is ordered by type and interface name, so equal lists have equal hashes.
+    auto hashConformance = [](Hasher& hasher, const ResolvedConformance& conformance)
+    {
+        hasher.update(uint64_t(reinterpret_cast<uintptr_t>(conformance.pType)));
+        hasher.update(uint64_t(reinterpret_cast<uintptr_t>(conformance.pInterfaceType)));
+        hasher.update(conformance.id);
+    };
+    Hasher hasher;
+    for (const auto& conformance : resolvedConformances)
+        hashConformance(hasher, conformance);
+    Hash128 listKey = hasher.getDigest();
+    auto compositeIt = cache.composites.find(listKey);
+    if (compositeIt != cache.composites.end())
+    {
+        cache.globalScopeComposites[nameKey] = compositeIt->second;
+        std::lock_guard<std::mutex> statsLock(mStatsMutex);
+        mCompilationStats.typeConformanceCacheHits++;
+        return compositeIt->second;
+    }
+    {
+        std::lock_guard<std::mutex> statsLock(mStatsMutex);
+        mCompilationStats.typeConformanceCacheMisses++;
+    }
+
+    // Create a composite component type that represents all type conformances
+    // linked into the `ProgramVersion`.
+    Slang::ComPtr<slang::IComponentType> pTypeConformancesCompositeComponent;
+    std::vector<slang::IComponentType*> typeConformanceComponentRawPtrList;
+
+    for (const auto& conformance : resolvedConformances)
+    {
+        // Conformance components are shared by all lists containing the conformance.
+        Hasher componentHasher;
+        hashConformance(componentHasher, conformance);
+        Slang::ComPtr<slang::ITypeConformance>& pTypeConformanceComponent = cache.components[componentHasher.getDigest()];
+        if (!pTypeConformanceComponent)
+        {
+            Slang::ComPtr<slang::IBlob> pSlangDiagnostics;
+            auto res = pSlangSession->createTypeConformanceComponentType(
+                conformance.pType,
+                conformance.pInterfaceType,
+                pTypeConformanceComponent.writeRef(),
+                (SlangInt)conformance.id,
+                pSlangDiagnostics.writeRef()
+            );
+            if (SLANG_FAILED(res))
+            {
+                log += "Slang call createTypeConformanceComponentType() failed.\n";
+                return {};
+            }
+            if (pSlangDiagnostics && pSlangDiagnostics->getBufferSize() > 0)
+            {
+                log += (char const*)pSlangDiagnostics->getBufferPointer();
+            }
+        }
+        if (pTypeConformanceComponent)
+        {
+            typeConformanceComponentRawPtrList.push_back(pTypeConformanceComponent.get());
+        }
+    }
+    if (!typeConformanceComponentRawPtrList.empty())
+    {
+        Slang::ComPtr<slang::IBlob> pSlangDiagnostics;
+        auto res = pSlangSession->createCompositeComponentType(
+            &typeConformanceComponentRawPtrList[0],
+            (SlangInt)typeConformanceComponentRawPtrList.size(),
+            pTypeConformancesCompositeComponent.writeRef(),
+            pSlangDiagnostics.writeRef()
+        );
+        if (SLANG_FAILED(res))
+        {
+            log += "Slang call createCompositeComponentType() failed.\n";
+            return {};
+        }
+    }
+    cache.composites[listKey] = pTypeConformancesCompositeComponent;
+    cache.globalScopeComposites[nameKey] = pTypeConformancesCompositeComponent;
+    return pTypeConformancesCompositeComponent;
+}
+
+void ProgramManager::setPermutationManifest(const std::filesystem::path& path)
+{
+    cancelPrecompile();
+    {
+        std::lock_guard<std::mutex> lock(mCacheMutex);
+        if (path.empty())
+            mpPermutationManifest.reset();
+        else
+            mpPermutationManifest = std::make_unique<PermutationManifest>(path);
+    }
+
+    std::lock_guard<std::mutex> lock(mLoadedProgramsMutex);
+    for (auto program : mLoadedPrograms)
+    {
+        std::lock_guard<std::mutex> versionLock(program->mVersionMutex);
+        schedulePrecompile(*program);
+    }
+}
+
+void ProgramManager::recordPermutation(const Program& program) const
+{
+    if (!mpPermutationManifest)
+        return;
+
+    PermutationManifest::Entry entry;
+    entry.programKey = computeProgramDescKey(program.mDesc);
+    entry.defines = program.getDefineList();
+    entry.typeConformances = program.getTypeConformances();
+    std::lock_guard<std::mutex> lock(mCacheMutex);
+    mpPermutationManifest->record(entry);
+}
+
+void ProgramManager::schedulePrecompile(Program& program)
+{
+    if (!mpPermutationManifest)
+        return;
+
+    Hash128 programKey = computeProgramDescKey(program.mDesc);
+    for (const auto& entry : mpPermutationManifest->getEntries())
+    {
+        if (entry.programKey != programKey)
+            continue;
+
+        // The permutation is compiled from a copy of the program, so the program itself can keep
+        // changing its defines and type conformances while the compile is running.
+        ref<Program> pPermutation(new Program(program.mpDevice, program.mDesc, entry.defines, false));
+        pPermutation->setTypeConformances(entry.typeConformances);
+        pPermutation->breakStrongReferenceToDevice();
+
+        Hash128 fingerprint = pPermutation->getVersionFingerprint();
+        if (program.mProgramVersions.count(fingerprint) != 0 || program.mPrecompiledVersions.count(fingerprint) != 0)
+            continue;
+
+        program.mPrecompiledVersions[fingerprint] = queuePrecompile(pPermutation, false);
+    }
+}
+
+std::shared_future<ref<const ProgramVersion>> ProgramManager::requestProgramVersion(const Program& program)
+{
+    ref<Program> pCopy(new Program(program.mpDevice, program.mDesc, program.mDefineList, false));
+    pCopy->setTypeConformances(program.mTypeConformanceList);
+    pCopy->breakStrongReferenceToDevice();
+
+    return queuePrecompile(pCopy, true);
+}
+
+std::shared_future<ref<const ProgramVersion>> ProgramManager::queuePrecompile(ref<Program> pProgram, bool request)
+{
+    const Hash128 key = computePermutationKey(*pProgram);
+    std::shared_ptr<PrecompileTask> pTask;
+    {
+        std::lock_guard<std::mutex> lock(mPrecompileMutex);
+        auto it = mPrecompiles.find(key);
+        if (it != mPrecompiles.end())
+        {
+            PrecompileTask& existing = *it->second;
+            if (!request || existing.request)
+                return existing.future;
+            if (!existing.running)
+            {
+                // Requests are compiled before the queued precompiles.
+                existing.request = true;
+                mPrecompileQueue.erase(std::find(mPrecompileQueue.begin(), mPrecompileQueue.end(), it->second));
+                mPrecompileQueue.push_front(it->second);
+                return existing.future;
+            }
+            // The running precompile doesn't generate the kernel code, the request is compiled separately.
+        }
+
+        pTask = std::make_shared<PrecompileTask>();
+        pTask->pProgram = std::move(pProgram);
+        pTask->future = pTask->promise.get_future().share();
+        pTask->key = key;
+        pTask->request = request;
+        mPrecompiles[key] = pTask;
+        if (request)
+            mPrecompileQueue.push_front(pTask);
+        else
+            mPrecompileQueue.push_back(pTask);
+        mPrecompileJobs++;
+    }
+    mpDevice->getTaskScheduler()->submit("precompile", [this]() { runPrecompileTask(); });
+    return pTask->future;
+}
+
+void ProgramManager::cancelPrecompile()
+{
+    std::unique_lock<std::mutex> lock(mPrecompileMutex);
+    for (auto& pTask : mPrecompileQueue)
+    {
+        pTask->promise.set_value(nullptr);
+        mPrecompiles.erase(pTask->key);
+    }
+    mPrecompileQueue.clear();
+
+    // Wait for the compiles in flight, they may read the configuration that is about to change.
+    mPrecompileCondition.wait(lock, [this] { return mPrecompilesRunning == 0; });
+}
+
+void ProgramManager::waitForPrecompile()
+{
+    std::unique_lock<std::mutex> lock(mPrecompileMutex);
+    mPrecompileCondition.wait(lock, [this] { return mPrecompileQueue.empty() && mPrecompilesRunning == 0; });
+}
+
+void ProgramManager::setProgramVersionBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mResidentMutex);
+    mProgramVersionBudget = bytes;
+    enforceProgramVersionBudget();
+}
+
+void ProgramManager::touchProgramVersion(const Program& program, const Hash128& fingerprint, const ProgramVersion* pVersion)
+{
+    std::lock_guard<std::mutex> lock(mResidentMutex);
+    auto it = mResidentVersionMap.find({&program, pVersion});
+    if (it != mResidentVersionMap.end())
+    {
+        mResidentVersions.splice(mResidentVersions.begin(), mResidentVersions, it->second);
+    }
+    else
+    {
+        mResidentVersions.push_front({&program, fingerprint, pVersion});
+        mResidentVersionMap[{&program, pVersion}] = mResidentVersions.begin();
+    }
+    enforceProgramVersionBudget(&program);
+}
+
+void ProgramManager::forgetProgramVersions(const Program& program)
+{
+    std::lock_guard<std::mutex> lock(mResidentMutex);
+    for (auto it = mResidentVersions.begin(); it != mResidentVersions.end();)
+    {
+        if (it->pProgram == &program)
+        {
+            mResidentVersionMap.erase({it->pProgram, it->pVersion});
+            it = mResidentVersions.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void ProgramManager::enforceProgramVersionBudget(const Program* pLockedProgram)
+{
+    if (mProgramVersionBudget == 0)
+        return;
+
+    std::vector<size_t> sizes;
+    sizes.reserve(mResidentVersions.size());
+    size_t totalSize = 0;
+    for (const auto& resident : mResidentVersions)
+    {
+        sizes.push_back(resident.pVersion->getApproximateSize());
+        totalSize += sizes.back();
+    }
+    if (totalSize <= mProgramVersionBudget)
+        return;
+
+    size_t versionsEvicted = 0;
+    size_t bytesEvicted = 0;
+    size_t kernelsEvicted = 0;
+
+    // Release the least recently activated versions first. The active version of a program is kept.
+    auto it = mResidentVersions.end();
+    size_t index = sizes.size();
+    while (it != mResidentVersions.begin() && totalSize > mProgramVersionBudget)
+    {
+        --it;
+        --index;
+        const Program& program = *it->pProgram;
+
+        // Don't wait for programs used by other threads, this would invert the lock order.
+        std::unique_lock<std::mutex> versionLock;
+        if (&program != pLockedProgram)
+        {
+            versionLock = std::unique_lock<std::mutex>(program.mVersionMutex, std::try_to_lock);
+            if (!versionLock.owns_lock())
+                continue;
+        }
+        if (it->pVersion == program.mpActiveVersion.get())
+            continue;
+
+        auto found = program.mProgramVersions.find(it->fingerprint);
+        if (found != program.mProgramVersions.end() && found->second.get() == it->pVersion)
+            program.mProgramVersions.erase(found);
+        mResidentVersionMap.erase({it->pProgram, it->pVersion});
+        it = mResidentVersions.erase(it);
+        totalSize -= sizes[index];
+        bytesEvicted += sizes[index];
+        versionsEvicted++;
+    }
+
+    // Trim the memoized kernels of the remaining versions, keeping the most recently used specialization.
+    for (auto rit = mResidentVersions.rbegin(); rit != mResidentVersions.rend() && totalSize > mProgramVersionBudget; ++rit)
+    {
+        size_t size = rit->pVersion->getApproximateSize();
+        size_t count = rit->pVersion->trimKernels(1);
+        if (count == 0)
+            continue;
+        size_t trimmedSize = rit->pVersion->getApproximateSize();
+        totalSize -= std::min(totalSize, size - trimmedSize);
+        kernelsEvicted += count;
+    }
+
+    std::lock_guard<std::mutex> statsLock(mStatsMutex);
+    mCompilationStats.programVersionsEvicted += versionsEvicted;
+    mCompilationStats.programVersionBytesEvicted += bytesEvicted;
+    mCompilationStats.kernelSpecializationsEvicted += kernelsEvicted;
+}
+
+void ProgramManager::runPrecompileTask()
+{
+    std::unique_lock<std::mutex> lock(mPrecompileMutex);
+    if (!mPrecompileQueue.empty())
+    {
+        std::shared_ptr<PrecompileTask> pTask = mPrecompileQueue.front();
+        mPrecompileQueue.pop_front();
+        pTask->running = true;
+        mPrecompilesRunning++;
+        lock.unlock();
+        runPrecompile(*pTask);
+        lock.lock();
+        finishPrecompile(pTask);
+    }
+    // The queue is empty if the precompile was cancelled or run by a waiting worker (see runQueuedPrecompile()).
+    mPrecompileJobs--;
+    mPrecompileCondition.notify_all();
+}
+
+void ProgramManager::runQueuedPrecompile(const Hash128& key)
+{
+    std::unique_lock<std::mutex> lock(mPrecompileMutex);
+    auto it = mPrecompiles.find(key);
+    if (it == mPrecompiles.end() || it->second->running)
+        return;
+
+    // The job submitted for the precompile runs the next queued precompile instead.
+    std::shared_ptr<PrecompileTask> pTask = it->second;
+    mPrecompileQueue.erase(std::find(mPrecompileQueue.begin(), mPrecompileQueue.end(), pTask));
+    pTask->running = true;
+    mPrecompilesRunning++;
+    lock.unlock();
+    runPrecompile(*pTask);
+    lock.lock();
+    finishPrecompile(pTask);
+}
+
+void ProgramManager::finishPrecompile(const std::shared_ptr<PrecompileTask>& pTask)
+{
+    // A request may have replaced the entry while the precompile was running.
+    auto it = mPrecompiles.find(pTask->key);
+    if (it != mPrecompiles.end() && it->second == pTask)
+        mPrecompiles.erase(it);
+    mPrecompilesRunning--;
+    mPrecompileCondition.notify_all();
+}
+
+void ProgramManager::runPrecompile(PrecompileTask& task)
+{
+    const uint32_t slangContext = getWorkerSlangContext();
+    std::string log;
+    ref<const ProgramVersion> pVersion;
+    if (task.request)
+    {
+        // Create the kernels and their code too, so that nothing is left to compile when the version is swapped in.
+        pVersion = createProgramVersion(*task.pProgram, log, slangContext);
+        ref<const ProgramKernels> pKernels = pVersion ? pVersion->getKernels(task.pProgram->getTypeConformances(), &log) : nullptr;
+        if (!pKernels || !pKernels->generateAll(mpDevice->getTaskScheduler()))
+            pVersion = nullptr;
+    }
+    else
+    {
+        {
+            std::lock_guard<std::mutex> compileLock(getSlangContext(slangContext).mutex);
+            pVersion = createProgramVersionImpl(*task.pProgram, slangContext, log);
+        }
+        if (pVersion)
+        {
+            std::lock_guard<std::mutex> statsLock(mStatsMutex);
+            mCompilationStats.permutationsPrecompiled++;
+        }
+    }
+    if (pVersion)
+    {
+        // The version refers to the copy it was compiled from, so the copy lives as long as the version.
+        // This is set before the version is published and never changes afterwards.
+        const_cast<ProgramVersion*>(pVersion.get())->mpProgramCopy = task.pProgram;
+    }
+    else
+    {
+        printf("Failed to %s program:\n%s\n\n%s\n", task.request ? "compile requested version of" : "precompile",
+            task.pProgram->getProgramDescString().c_str(), log.c_str());
+    }
+    task.promise.set_value(pVersion);
+    task.pProgram = nullptr;
+}
+
+std::vector<ProgramManager::BatchResult> ProgramManager::compileBatch(const std::vector<ref<Program>>& programs, bool parallel)
+{
+    TaskScheduler* pScheduler = mpDevice->getTaskScheduler();
+    std::vector<BatchResult> results(programs.size());
+    auto compileProgram = [&](size_t index)
+    {
+        const Program& program = *programs[index];
+        BatchResult& result = results[index];
+        CpuTimer timer;
+        timer.update();
+
+        const uint32_t slangContext = getWorkerSlangContext();
+        result.pVersion = program.activateVersion(result.log, slangContext);
+        if (result.pVersion)
+            result.pKernels = result.pVersion->getKernels(program.getTypeConformances(), &result.log);
+        result.success = result.pKernels != nullptr;
+
+        // Generate the code of all kernels, so that nothing is left to compile when the program is used.
+        if (result.pKernels && !result.pKernels->generateAll(parallel ? pScheduler : nullptr))
+        {
+            result.log += "Failed to generate kernel code for program:\n" + program.getProgramDescString() + "\n";
+            result.success = false;
+        }
+
+        timer.update();
+        result.time = timer.delta();
+    };
+
+    if (!parallel)
+    {
+        for (size_t i = 0; i < programs.size(); i++)
+            compileProgram(i);
+        return results;
+    }
+
+    std::vector<TaskScheduler::TaskHandle> tasks;
+    for (size_t i = 0; i < programs.size(); i++)
+        tasks.push_back(pScheduler->submit("compileProgram", [&compileProgram, i]() { compileProgram(i); }));
+    pScheduler->wait(tasks);
+    return results;
+}
+
+ref<const ProgramVersion> ProgramManager::takePrecompiledVersion(const Program& program, const Hash128& fingerprint)
+{
+    auto it = program.mPrecompiledVersions.find(fingerprint);
+    if (it == program.mPrecompiledVersions.end())
+        return nullptr;
+
+    // Only workers get here before the version is ready (see Program::waitForPrecompiledVersion()).
+    // Rather than waiting for a worker to start the precompile, they run it. A running precompile
+    // compiles from a copy of the program, so it doesn't need the version lock held here.
+    if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        runQueuedPrecompile(computePermutationKey(program));
+        it->second.wait();
+    }
+    ref<const ProgramVersion> pVersion = it->second.get();
+    program.mPrecompiledVersions.erase(it);
+    if (!pVersion)
+        return nullptr;
+
+    // The version stays bound to the copy it was compiled from (see runPrecompile()), which has the same
+    // description, so programs with the same description can share it.
+    for (const auto& dependency : pVersion->getFileDependencies())
+        program.mFileDependencies[dependency.path] = dependency;
+
+    std::lock_guard<std::mutex> statsLock(mStatsMutex);
+    mCompilationStats.precompiledVersionsUsed++;
+    return pVersion;
+}
+
+void ProgramManager::setShaderCache(const ShaderCacheDesc& desc)
+{
+    cancelPrecompile();
+    mCodeBlobStore.setDiskCache(nullptr);
+    mShaderCacheDesc = desc;
+    if (desc.directory.empty())
+    {
+        mpShaderCache.reset();
+        mpManifestCache.reset();
+    }
+    else
+    {
+        mpShaderCache = std::make_unique<ShaderCache>(desc.directory);
+        mpManifestCache = std::make_unique<ShaderCache>(desc.directory / "manifests");
+    }
+    mCodeBlobStore.setDiskCache(mpShaderCache.get());
+}
+
+ProgramManager::CompilationStats ProgramManager::getCompilationStats()
+{
+    CompilationStats stats;
+    {
+        std::lock_guard<std::mutex> lock(mStatsMutex);
+        stats = mCompilationStats;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mResidentMutex);
+        stats.residentProgramVersions = mResidentVersions.size();
+        stats.residentProgramVersionBytes = 0;
+        for (const auto& resident : mResidentVersions)
+            stats.residentProgramVersionBytes += resident.pVersion->getApproximateSize();
+    }
+
+    if (mpShaderCache)
+    {
+        const ShaderCache::Stats shaderCacheStats = mCodeBlobStore.getDiskCacheStats();
+        stats.kernelCacheHits = shaderCacheStats.hitCount;
+        stats.kernelCacheMisses = shaderCacheStats.missCount;
+    }
+
+    std::lock_guard<std::mutex> lock(mCacheMutex);
+    if (mpModuleCache)
+    {
+        stats.slangModulesLoaded = mpModuleCache->getStats().modulesLoaded;
+        stats.slangModulesStored = mpModuleCache->getStats().modulesStored;
+    }
+    return stats;
+}
+
+void ProgramManager::recordProgramVersionTime(double time, bool cacheHit) const
+{
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    mCompilationStats.programVersionCount++;
+    if (cacheHit)
+        mCompilationStats.programVersionCacheHits++;
+    mCompilationStats.programVersionTotalTime += time;
+    mCompilationStats.programVersionMaxTime = std::max(mCompilationStats.programVersionMaxTime, time);
+}
+
+void ProgramManager::recordVersionSwap(double time)
+{
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    mCompilationStats.versionSwaps++;
+    mCompilationStats.versionSwapTotalTime += time;
+    mCompilationStats.versionSwapMaxTime = std::max(mCompilationStats.versionSwapMaxTime, time);
+}
+
+void ProgramManager::recordProgramKernelsTime(double time) const
+{
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    mCompilationStats.programKernelsCount++;
+    mCompilationStats.programKernelsTotalTime += time;
+    mCompilationStats.programKernelsMaxTime = std::max(mCompilationStats.programKernelsMaxTime, time);
+}
+
+EntryPointKernel::CodegenCallback ProgramManager::getCodegenCallback() const
+{
+    return [this](uint32_t targetIndex, double time, uint64_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mStatsMutex);
+        std::vector<TargetCodegenStats>& targetCodegen = mCompilationStats.targetCodegen;
+        if (targetCodegen.size() <= targetIndex)
+            targetCodegen.resize(targetIndex + 1);
+        targetCodegen[targetIndex].kernelCount++;
+        targetCodegen[targetIndex].time += time;
+        targetCodegen[targetIndex].bytes += bytes;
+    };
+}
+
+void ProgramManager::resetCompilationStats()
+{
+    {
+        std::lock_guard<std::mutex> statsLock(mStatsMutex);
+        mCompilationStats = {};
+    }
+    mCodeBlobStore.resetStats();
+    std::lock_guard<std::mutex> lock(mCacheMutex);
+    if (mpModuleCache)
+        mpModuleCache->resetStats();
+}
+
+SlangCompilerFlags ProgramManager::getCompilerFlags(const Program& program) const
+{
+    return getCompilerFlags(program, mForcedCompilerFlags);
+}
+
+SlangCompilerFlags ProgramManager::getCompilerFlags(const Program& program, const ForcedCompilerFlags& forcedCompilerFlags) const
+{
+    // Get compiler flags and adjust with forced flags.
+    SlangCompilerFlags compilerFlags = program.mDesc.compilerFlags;
+    compilerFlags = SlangCompilerFlags(compilerFlags & (~forcedCompilerFlags.disabled));
+    compilerFlags = SlangCompilerFlags(compilerFlags | forcedCompilerFlags.enabled);
+    return compilerFlags;
+}
+
+DefineList ProgramManager::getSessionDefines(const Program& program) const
+{
+    // Global followed by program specific defines.
+    DefineList defines = mGlobalDefineList;
+    defines.add(program.getDefineList());
+
+    // Add a `#define`s based on the target.
+    switch (mpDevice->getType())
+    {
+    case Device::Type::D3D12:
+        defines.add("FALCOR_D3D12", "1");
+        break;
+    case Device::Type::Vulkan:
+        defines.add("FALCOR_VULKAN", "1");
+        break;
+    default:
+        assert(!"Unreachable");
+    }
+
+    // Add a `#define` based on the shader model.
+    char buffer[80];
+    std::snprintf(buffer, sizeof(buffer), "__SM_%d_%d__", getShaderModelMajorVersion(program.mDesc.shaderModel), getShaderModelMinorVersion(program.mDesc.shaderModel));
+    defines.add(buffer, "1");
+
+    return defines;
+}
+
+void ProgramManager::hashCompilerConfiguration(Hasher& hasher, const Program& program) const
+{
+    hasher.update(mpDevice->getSlangGlobalSession()->getBuildTagString());
+    hasher.update(mpDevice->getType());
+    hasher.update(getSlangProfileString(program.mDesc.shaderModel));
+    hasher.update(getCompilerFlags(program));
+    hasher.update(m_enableSpirvDirect);
+    hasher.update(uint64_t(mAdditionalTargets.size()));
+    for (const auto& target : mAdditionalTargets)
+    {
+        hasher.update(target.format);
+        hasher.update(target.spirvDirect);
+    }
+    hasher.update(mUseCompileRequest || !canUseSessionFrontEnd(program));
+    hasher.update(mGenerateDebugInfo);
+    hasher.update(uint64_t(mGlobalCompilerArguments.size()));
+    for (const auto& arg : mGlobalCompilerArguments)
+        hasher.update(arg);
+    hasher.update(uint64_t(program.mDesc.compilerArguments.size()));
+    for (const auto& arg : program.mDesc.compilerArguments)
+        hasher.update(arg);
+    for (const auto& path : getShaderDirectoriesList())
+        hasher.update(path.string());
+}
+
+Hash128 ProgramManager::computeSessionCacheKey(const Program& program) const
+{
+    Hasher hasher;
+    hasher.update(kShaderCacheKeyVersion);
+    hashCompilerConfiguration(hasher, program);
+    return hasher.getDigest();
+}
+
+bool ProgramManager::loadDependencyManifest(const Hash128& lookupKey, ShaderFileDependencyList& dependencies) const
+{
+    std::vector<uint8_t> data;
+    {
+        std::lock_guard<std::mutex> lock(mCacheMutex);
+        if (!mpManifestCache->load(lookupKey, data))
+            return false;
+    }
+    if (!deserializeShaderFileDependencies(data, dependencies))
+        return false;
+
+    for (auto& dependency : dependencies)
+    {
+        if (!isShaderFileDependencyUpToDate(dependency))
+            return false;
+    }
+    return true;
+}
+
+void ProgramManager::storeDependencyManifest(const Hash128& lookupKey, const ShaderFileDependencyList& dependencies) const
+{
+    std::vector<uint8_t> data;
+    serializeShaderFileDependencies(dependencies, data);
+
+    std::vector<uint8_t> existing;
+    std::lock_guard<std::mutex> lock(mCacheMutex);
+    if (mpManifestCache->load(lookupKey, existing) && existing == data)
+        return;
+    mpManifestCache->store(lookupKey, data.data(), data.size());
+}
+
+void ProgramManager::collectFileDependencies(const std::vector<std::string>& paths, ShaderFileDependencyList& dependencies) const
+{
+    std::set<std::string> uniquePaths;
+    for (const auto& path : paths)
+    {
+        if (!uniquePaths.insert(path).second)
+            continue;
+
+        // Prefer the state recorded when Slang read the file. Files of modules that were
+        // already loaded in a pooled session or loaded from the module cache are not read
+        // again, so we fall back to the current state of those.
+        ShaderFileDependency dependency;
+        if (mpFileSystem->findFile(path, dependency) || getShaderFileDependency(path, dependency))
+            dependencies.push_back(std::move(dependency));
+    }
+    std::sort(
+        dependencies.begin(),
+        dependencies.end(),
+        [](const ShaderFileDependency& a, const ShaderFileDependency& b) { return a.path < b.path; }
+    );
+}
+
+Hash128 ProgramManager::computeProgramVersionLookupKey(const Program& program) const
+{
+    Hasher hasher;
+    hasher.update(kShaderCacheKeyVersion);
+    hashCompilerConfiguration(hasher, program);
+
+    // Macro definitions and type conformances.
+    hashDefineList(hasher, mGlobalDefineList);
+    hasher.update(program.getVersionFingerprint());
+
+    // Shader modules and entry points. The contents of the source files are covered by the dependency manifest.
+    hasher.update(computeProgramDescKey(program.mDesc));
+
+    return hasher.getDigest();
+}
+
+Slang::ComPtr<slang::ISession> ProgramManager::createSlangSession(const Program& program, SlangContext& context, bool useCompileRequest) const
+{
+    slang::IGlobalSession* pSlangGlobalSession = context.pGlobalSession;
+    ASSERT(pSlangGlobalSession);
+
+    slang::SessionDesc sessionDesc;
+
+    // Add our shader search paths as `#include` search paths for Slang.
+    //
+    // Note: Slang allows application to plug in a callback API to
     // implement file I/O, and this could be used instead of specifying
     // the data directories to Slang.
     //
@@ -535,6 +1857,9 @@ SlangCompileRequest* ProgramManager::createSlangCompileRequest(const Program& pr
     sessionDesc.searchPaths = slangSearchPaths.data();
     sessionDesc.searchPathCount = (SlangInt)slangSearchPaths.size();
 
+    // Read all files through our file system to record the dependencies of each compile.
+    sessionDesc.fileSystem = mpFileSystem;
+
     slang::TargetDesc targetDesc;
     targetDesc.format = SLANG_TARGET_UNKNOWN;
     targetDesc.profile = pSlangGlobalSession->findProfile(getSlangProfileString(program.mDesc.shaderModel).c_str());
@@ -542,10 +1867,7 @@ SlangCompileRequest* ProgramManager::createSlangCompileRequest(const Program& pr
     if (targetDesc.profile == SLANG_PROFILE_UNKNOWN)
         printf("Can't find Slang profile for shader model %d\n", static_cast<int>(program.mDesc.shaderModel));
 
-    // Get compiler flags and adjust with forced flags.
-    SlangCompilerFlags compilerFlags = program.mDesc.compilerFlags;
-    compilerFlags = SlangCompilerFlags(compilerFlags & (~mForcedCompilerFlags.disabled));
-    compilerFlags = SlangCompilerFlags(compilerFlags | mForcedCompilerFlags.enabled);
+    SlangCompilerFlags compilerFlags = getCompilerFlags(program);
 
     // Set floating point mode. If no shader compiler flags for this were set, we use Slang's default mode.
     bool flagFast = is_set(compilerFlags, SlangCompilerFlags::FloatingPointModeFast);
@@ -574,18 +1896,14 @@ SlangCompileRequest* ProgramManager::createSlangCompileRequest(const Program& pr
         targetDesc.flags |= SLANG_TARGET_FLAG_GENERATE_SPIRV_DIRECTLY;
     }
 
-    const char* targetMacroName;
-
     // Pick the right target based on the current graphics API
     switch (mpDevice->getType())
     {
     case Device::Type::D3D12:
         targetDesc.format = SLANG_DXIL;
-        targetMacroName = "FALCOR_D3D12";
         break;
     case Device::Type::Vulkan:
         targetDesc.format = SLANG_SPIRV;
-        targetMacroName = "FALCOR_VULKAN";
         break;
     default:
         assert(!"Unreachable");
@@ -594,30 +1912,29 @@ SlangCompileRequest* ProgramManager::createSlangCompileRequest(const Program& pr
     // Pass any `#define` flags along to Slang, since we aren't doing our
     // own preprocessing any more.
     //
+    DefineList defines = getSessionDefines(program);
     std::vector<slang::PreprocessorMacroDesc> slangDefines;
-    const auto addSlangDefine = [&slangDefines](const char* name, const char* value) { slangDefines.push_back({name, value}); };
-
-    // Add global followed by program specific defines.
-    for (const auto& shaderDefine : mGlobalDefineList)
-        addSlangDefine(shaderDefine.first.c_str(), shaderDefine.second.c_str());
-    for (const auto& shaderDefine : program.getDefineList())
-        addSlangDefine(shaderDefine.first.c_str(), shaderDefine.second.c_str());
-
-    // Add a `#define`s based on the target and shader model.
-    addSlangDefine(targetMacroName, "1");
-
-    // Add a `#define` based on the shader model.
-    char buffer[80];
-    std::snprintf(buffer, sizeof(buffer), "__SM_%d_%d__", getShaderModelMajorVersion(program.mDesc.shaderModel), getShaderModelMinorVersion(program.mDesc.shaderModel));
-    std::string sm(buffer);
-
-    addSlangDefine(sm.c_str(), "1");
+    for (const auto& shaderDefine : defines)
+        slangDefines.push_back({shaderDefine.first.c_str(), shaderDefine.second.c_str()});
 
     sessionDesc.preprocessorMacros = slangDefines.data();
     sessionDesc.preprocessorMacroCount = (SlangInt)slangDefines.size();
 
-    sessionDesc.targets = &targetDesc;
-    sessionDesc.targetCount = 1;
+    // Additional targets share the settings of the device target. The front-end runs once for
+    // all targets, code is generated per target.
+    std::vector<slang::TargetDesc> targetDescs = {targetDesc};
+    for (const auto& target : mAdditionalTargets)
+    {
+        slang::TargetDesc additionalTargetDesc = targetDesc;
+        additionalTargetDesc.format = target.format;
+        additionalTargetDesc.flags &= ~SLANG_TARGET_FLAG_GENERATE_SPIRV_DIRECTLY;
+        if (target.spirvDirect)
+            additionalTargetDesc.flags |= SLANG_TARGET_FLAG_GENERATE_SPIRV_DIRECTLY;
+        targetDescs.push_back(additionalTargetDesc);
+    }
+
+    sessionDesc.targets = targetDescs.data();
+    sessionDesc.targetCount = (SlangInt)targetDescs.size();
 
     // We always use row-major matrix layout in Falcor so by default that's what we pass to Slang
     // to allow it to compute correct reflection information. Slang then invokes the downstream compiler.
@@ -626,13 +1943,75 @@ SlangCompileRequest* ProgramManager::createSlangCompileRequest(const Program& pr
     bool useColumnMajor = is_set(compilerFlags, SlangCompilerFlags::MatrixLayoutColumnMajor);
     sessionDesc.defaultMatrixLayoutMode = useColumnMajor ? SLANG_MATRIX_LAYOUT_COLUMN_MAJOR : SLANG_MATRIX_LAYOUT_ROW_MAJOR;
 
-    Slang::ComPtr<slang::ISession> pSlangSession;
-    pSlangGlobalSession->createSession(sessionDesc, pSlangSession.writeRef());
+    // Command line arguments and the debug info level are applied to the session's linkage,
+    // so they are part of the session configuration.
+    std::vector<const char*> args;
+    for (const auto& arg : mGlobalCompilerArguments)
+        args.push_back(arg.c_str());
+    for (const auto& arg : program.mDesc.compilerArguments)
+        args.push_back(arg.c_str());
+    bool debugInfo = mGenerateDebugInfo || is_set(program.mDesc.compilerFlags, SlangCompilerFlags::GenerateDebugInfo);
+
+    // Without a compile request, the options are passed to the session.
+    std::vector<slang::CompilerOptionEntry> compilerOptions;
+    Slang::ComPtr<ISlangUnknown> pArgsAllocation;
+    if (!useCompileRequest)
+    {
+        auto addOption = [&](slang::CompilerOptionName name, int32_t intValue, const char* stringValue = nullptr)
+        {
+            slang::CompilerOptionEntry entry;
+            entry.name = name;
+            entry.value.kind = stringValue ? slang::CompilerOptionValueKind::String : slang::CompilerOptionValueKind::Int;
+            entry.value.intValue0 = intValue;
+            entry.value.stringValue0 = stringValue;
+            compilerOptions.push_back(entry);
+        };
+
+        // Disable noisy warnings enabled in newer slang versions.
+        addOption(slang::CompilerOptionName::DisableWarning, 0, "15602"); // #pragma once in modules
+        addOption(slang::CompilerOptionName::DisableWarning, 0, "30081"); // implicit conversion
+
+        if (is_set(program.mDesc.compilerFlags, SlangCompilerFlags::DumpIntermediates))
+            addOption(slang::CompilerOptionName::DumpIntermediates, 1);
+        if (debugInfo)
+            addOption(slang::CompilerOptionName::DebugInformation, SLANG_DEBUG_INFO_LEVEL_STANDARD);
+
+        if (!args.empty())
+        {
+            slang::SessionDesc argsSessionDesc;
+            if (SLANG_FAILED(pSlangGlobalSession->parseCommandLineArguments(
+                    (int)args.size(), args.data(), &argsSessionDesc, pArgsAllocation.writeRef()
+                )))
+                printf("Warning: Failed to parse compiler arguments\n");
+            compilerOptions.insert(
+                compilerOptions.end(),
+                argsSessionDesc.compilerOptionEntries,
+                argsSessionDesc.compilerOptionEntries + argsSessionDesc.compilerOptionEntryCount
+            );
+        }
+
+        sessionDesc.compilerOptionEntries = compilerOptions.data();
+        sessionDesc.compilerOptionEntryCount = (uint32_t)compilerOptions.size();
+    }
+
+    Slang::ComPtr<slang::ISession> pSlangSession = acquireSession(context, sessionDesc, computeSessionPoolKey(sessionDesc, args, debugInfo));
     ASSERT(pSlangSession);
 
+    // Load previously checked modules imported by this program, so that Slang doesn't
+    // need to parse and check them again.
+    if (mpModuleCache)
+    {
+        std::set<std::string> translationUnitPaths;
+        Hash128 programKey = computeTranslationUnitsKey(program.mDesc, translationUnitPaths);
+        std::lock_guard<std::mutex> cacheLock(mCacheMutex);
+        mpModuleCache->loadModules(pSlangSession, computeSessionCacheKey(program), programKey, defines);
+    }
 
-    program.mFileTimeMap.clear(); // TODO @skallweit
+    return pSlangSession;
+}
 
+SlangCompileRequest* ProgramManager::createSlangCompileRequest(const Program& program, slang::ISession* pSlangSession) const
+{
     SlangCompileRequest* pSlangRequest = nullptr;
     pSlangSession->createCompileRequest(&pSlangRequest);
     ASSERT(pSlangRequest);
@@ -660,19 +2039,14 @@ SlangCompileRequest* ProgramManager::createSlangCompileRequest(const Program& pr
 
     spSetCompileFlags(pSlangRequest, slangFlags);
 
-    std::vector<const char*> argsDump;
     // Set additional command line arguments.
-    {
-        std::vector<const char*> args;
-        for (const auto& arg : mGlobalCompilerArguments)
-            args.push_back(arg.c_str());
-        for (const auto& arg : program.mDesc.compilerArguments)
-            args.push_back(arg.c_str());
-
-        if (!args.empty())
-            spProcessCommandLineArguments(pSlangRequest, args.data(), (int)args.size());
-        argsDump = args;
-    }
+    std::vector<const char*> args;
+    for (const auto& arg : mGlobalCompilerArguments)
+        args.push_back(arg.c_str());
+    for (const auto& arg : program.mDesc.compilerArguments)
+        args.push_back(arg.c_str());
+    if (!args.empty())
+        spProcessCommandLineArguments(pSlangRequest, args.data(), (int)args.size());
 
     for (size_t moduleIndex = 0; moduleIndex < program.mDesc.shaderModules.size(); ++moduleIndex)
     {
@@ -728,3 +2102,169 @@ SlangCompileRequest* ProgramManager::createSlangCompileRequest(const Program& pr
 
     return pSlangRequest;
 }
+
+bool ProgramManager::runFrontEndWithCompileRequest(const Program& program, SlangContext& context, FrontEndResult& result, std::string& log) const
+{
+    Slang::ComPtr<slang::ISession> pSlangSession = createSlangSession(program, context, true);
+    SlangCompileRequest* pSlangRequest = createSlangCompileRequest(program, pSlangSession);
+    if (pSlangRequest == nullptr)
+        return false;
+
+    SlangResult slangResult = spCompile(pSlangRequest);
+    log += spGetDiagnosticOutput(pSlangRequest);
+    if (SLANG_FAILED(slangResult))
+    {
+        spDestroyCompileRequest(pSlangRequest);
+        return false;
+    }
+
+    spCompileRequest_getProgram(pSlangRequest, result.pSlangGlobalScope.writeRef());
+    for (const auto& entryPointGroup : program.mDesc.entryPointGroups)
+    {
+        for (const auto& entryPoint : entryPointGroup.entryPoints)
+        {
+            if (result.pSlangEntryPoints.size() <= entryPoint.globalIndex)
+                result.pSlangEntryPoints.resize(entryPoint.globalIndex + 1);
+            spCompileRequest_getEntryPoint(pSlangRequest, entryPoint.globalIndex, result.pSlangEntryPoints[entryPoint.globalIndex].writeRef());
+        }
+    }
+
+    int count = spGetDependencyFileCount(pSlangRequest);
+    for (int i = 0; i < count; ++i)
+        result.dependencyPaths.push_back(spGetDependencyFilePath(pSlangRequest, i));
+
+    spDestroyCompileRequest(pSlangRequest);
+    return true;
+}
+
+bool ProgramManager::canUseSessionFrontEnd(const Program& program) const
+{
+    // A module is loaded from a single source. Modules made of several sources need a translation unit.
+    for (const auto& module : program.mDesc.shaderModules)
+    {
+        if (module.sources.size() != 1)
+            return false;
+    }
+    return true;
+}
+
+bool ProgramManager::runFrontEndWithSession(const Program& program, SlangContext& context, FrontEndResult& result, std::string& log) const
+{
+    Slang::ComPtr<slang::ISession> pSlangSession = createSlangSession(program, context, false);
+
+    auto appendDiagnostics = [&log](slang::IBlob* pDiagnostics)
+    {
+        if (pDiagnostics && pDiagnostics->getBufferSize() > 0)
+            log += std::string((const char*)pDiagnostics->getBufferPointer(), pDiagnostics->getBufferSize());
+    };
+
+    // Load each shader module. A module already loaded into a pooled session is reused.
+    std::vector<Slang::ComPtr<slang::IModule>> pSlangModules;
+    std::vector<slang::IComponentType*> componentTypes;
+    for (const auto& module : program.mDesc.shaderModules)
+    {
+        const auto& source = module.sources.front();
+        Slang::ComPtr<slang::IBlob> pDiagnostics;
+        Slang::ComPtr<slang::IModule> pSlangModule;
+        if (source.type == ProgramDesc::ShaderSource::Type::File)
+        {
+            const auto& path = source.path;
+            if (!(hasExtension(path, "hlsl") || hasExtension(path, "slang")))
+            {
+                printf("Warning: "
+                    "Compiling a shader file which is not a SLANG file or an HLSL file. This is not an error, but make sure that the "
+                    "file contains valid shaders"
+                );
+            }
+            std::filesystem::path fullPath;
+            if (!findFileInShaderDirectories(path, fullPath))
+            {
+                log += std::string("Can't find shader file ") + path.string() + "\n";
+                return false;
+            }
+
+            // Use the name an `import` of the file resolves to, so that importing the module elsewhere doesn't load it again.
+            std::string name = module.name;
+            if (name.empty())
+            {
+                name = std::filesystem::path(path).replace_extension().generic_string();
+                std::replace(name.begin(), name.end(), '/', '.');
+            }
+
+            // Read the file through our file system to record it as a dependency.
+            Slang::ComPtr<slang::IBlob> pSource;
+            if (SLANG_FAILED(mpFileSystem->loadFile(fullPath.string().c_str(), pSource.writeRef())))
+            {
+                log += std::string("Can't read shader file ") + fullPath.string() + "\n";
+                return false;
+            }
+            pSlangModule = pSlangSession->loadModuleFromSource(name.c_str(), fullPath.string().c_str(), pSource, pDiagnostics.writeRef());
+        }
+        else
+        {
+            ASSERT(source.type == ProgramDesc::ShaderSource::Type::String);
+            // Modules are identified by name within a session, so unnamed string modules are named after their contents.
+            std::string name = module.name;
+            if (name.empty())
+            {
+                Hasher hasher;
+                hasher.update(source.path.string());
+                hasher.update(source.string);
+                name = "falcor_string_" + hasher.getDigest().toString();
+            }
+            pSlangModule = pSlangSession->loadModuleFromSourceString(
+                name.c_str(), source.path.string().c_str(), source.string.c_str(), pDiagnostics.writeRef()
+            );
+        }
+        appendDiagnostics(pDiagnostics);
+        if (!pSlangModule)
+            return false;
+
+        for (SlangInt32 i = 0; i < pSlangModule->getDependencyFileCount(); ++i)
+            result.dependencyPaths.push_back(pSlangModule->getDependencyFilePath(i));
+        componentTypes.push_back(pSlangModule);
+        pSlangModules.push_back(pSlangModule);
+    }
+
+    // The global scope covers all shader modules, like the program of a compile request.
+    Slang::ComPtr<slang::IBlob> pDiagnostics;
+    SlangResult res = pSlangSession->createCompositeComponentType(
+        componentTypes.data(), (SlangInt)componentTypes.size(), result.pSlangGlobalScope.writeRef(), pDiagnostics.writeRef()
+    );
+    appendDiagnostics(pDiagnostics);
+    if (SLANG_FAILED(res))
+    {
+        log += "Slang call createCompositeComponentType() failed.\n";
+        return false;
+    }
+
+    for (const auto& entryPointGroup : program.mDesc.entryPointGroups)
+    {
+        slang::IModule* pSlangModule = pSlangModules[entryPointGroup.shaderModuleIndex];
+        for (const auto& entryPoint : entryPointGroup.entryPoints)
+        {
+            // Entry points with a `[shader]` attribute are found by name. Others need the stage, as
+            // with `spAddEntryPoint()`.
+            Slang::ComPtr<slang::IEntryPoint> pSlangEntryPoint;
+            pSlangModule->findEntryPointByName(entryPoint.name.c_str(), pSlangEntryPoint.writeRef());
+            if (!pSlangEntryPoint)
+            {
+                Slang::ComPtr<slang::IBlob> pEntryPointDiagnostics;
+                pSlangModule->findAndCheckEntryPoint(
+                    entryPoint.name.c_str(), getSlangStage(entryPoint.type), pSlangEntryPoint.writeRef(), pEntryPointDiagnostics.writeRef()
+                );
+                appendDiagnostics(pEntryPointDiagnostics);
+            }
+            if (!pSlangEntryPoint)
+            {
+                log += std::string("Can't find entry point '") + entryPoint.name + "'.\n";
+                return false;
+            }
+
+            if (result.pSlangEntryPoints.size() <= entryPoint.globalIndex)
+                result.pSlangEntryPoints.resize(entryPoint.globalIndex + 1);
+            result.pSlangEntryPoints[entryPoint.globalIndex] = Slang::ComPtr<slang::IComponentType>(pSlangEntryPoint.get());
+        }
+    }
+    return true;
+}
@@ -5,10 +5,24 @@
  **************************************************************************/
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include "CodeBlobStore.h"
+#include "Hash.h"
 #include "Program.h"
 #include "ProgramVersion.h"
 #include "ProgramReflection.h"
+#include "ShaderFileInfo.h"
 #include "Types.h"
 
 struct ProgramDesc;
@@ -16,11 +30,17 @@ class Device;
 class Program;
 class ProgramVersion;
 class ProgramKernels;
+class DependencyTrackingFileSystem;
+class ShaderCache;
+class TypeConformanceList;
+class SlangModuleCache;
+class PermutationManifest;
 
 class ProgramManager
 {
 public:
     ProgramManager(Device* pDevice);
+    ~ProgramManager();
 
     /**
      * Defines flags that should be forcefully disabled or enabled on all shaders.
@@ -32,6 +52,28 @@ public:
         SlangCompilerFlags disabled = SlangCompilerFlags::None; ///< Compiler flags forcefully enabled on all shaders
     };
 
+    /**
+     * Persistent shader cache configuration.
+     */
+    struct ShaderCacheDesc
+    {
+        /// Cache directory. The shader cache is disabled if this is empty.
+        std::filesystem::path directory;
+        /// If the code of all kernels of a program version is found in the cache, create the version
+        /// without running the Slang front-end. Kernels of such versions only carry kernel code and
+        /// have no gfx program.
+        bool skipFrontEndOnHit = false;
+    };
+
+    /**
+     * Result of a selective program reload.
+     */
+    struct ReloadResult
+    {
+        size_t kept = 0;    ///< Programs whose compiled versions were kept.
+        size_t rebuilt = 0; ///< Programs that were reset and will be recompiled on next use.
+    };
+
     struct CompilationStats
     {
         size_t programVersionCount = 0;
@@ -40,17 +82,106 @@ public:
         double programKernelsMaxTime = 0.0;
         double programVersionTotalTime = 0.0;
         double programKernelsTotalTime = 0.0;
+        size_t programVersionCacheHits = 0; ///< Program versions created from the shader cache without running the Slang front-end.
+        size_t kernelCacheHits = 0;         ///< Kernel code loaded from the shader cache.
+        size_t kernelCacheMisses = 0;       ///< Kernel code not found in the shader cache.
+        size_t slangModulesLoaded = 0;      ///< Slang modules loaded from the module cache instead of source.
+        size_t slangModulesStored = 0;      ///< Slang modules serialized into the module cache.
+        size_t sessionPoolHits = 0;         ///< Compile requests that reused a pooled Slang session.
+        size_t sessionPoolMisses = 0;       ///< Compile requests that had to create a new Slang session.
+        size_t sessionPoolEvictions = 0;    ///< Pooled Slang sessions evicted to stay within the pool size.
+        size_t permutationsPrecompiled = 0; ///< Program versions compiled in the background from the permutation manifest.
+        size_t precompiledVersionsUsed = 0; ///< Program versions compiled in the background that a program used.
+        size_t versionSwaps = 0;            ///< Versions from `Program::requestActiveVersion()` swapped in.
+        double versionSwapTotalTime = 0.0;  ///< Time from request to swap of the swapped versions, in seconds.
+        double versionSwapMaxTime = 0.0;
+        size_t residentProgramVersions = 0;      ///< Program versions currently held by programs.
+        uint64_t residentProgramVersionBytes = 0; ///< Approximate memory of the resident program versions and their kernels.
+        size_t programVersionsEvicted = 0;       ///< Program versions released to stay within the memory budget.
+        uint64_t programVersionBytesEvicted = 0; ///< Approximate memory of the evicted program versions.
+        size_t kernelSpecializationsEvicted = 0; ///< Memoized kernels released to stay within the memory budget.
+        size_t typeConformanceCacheHits = 0;     ///< Type conformance composites reused by kernel creation.
+        size_t typeConformanceCacheMisses = 0;   ///< Type conformance composites created by kernel creation.
+        std::vector<TargetCodegenStats> targetCodegen; ///< Kernel code generation per target. Target 0 is the device target.
     };
 
     ProgramDesc applyForcedCompilerFlags(ProgramDesc desc) const;
     void registerProgramForReload(Program* program);
     void unregisterProgramForReload(Program* program);
 
-    ref<const ProgramVersion> createProgramVersion(const Program& program, std::string& log) const;
+    /**
+     * Result of compiling a program with `compileBatch()`.
+     */
+    struct BatchResult
+    {
+        bool success = false;
+        ref<const ProgramVersion> pVersion; ///< Active version of the program.
+        ref<const ProgramKernels> pKernels; ///< Kernels for the type conformances of the program, with their code generated.
+        std::string log;                    ///< Errors and warnings.
+        double time = 0.0;                  ///< Time spent compiling the program, in seconds.
+    };
+
+    /**
+     * Create a program version with the current defines and type conformances of a program.
+     * Can be called from several threads. The Slang work of all threads using the same Slang
+     * context is serialized, since a Slang global session must not be used from more than one
+     * thread at a time.
+     * @param[in] slangContext Slang context to compile with. Context 0 uses the global session of
+     * the device, the others are used by the workers of the task scheduler.
+     */
+    ref<const ProgramVersion> createProgramVersion(const Program& program, std::string& log, uint32_t slangContext = 0) const;
+
+    /**
+     * Compile the active versions of a list of programs, their kernels and the kernel code as
+     * jobs of the device's task scheduler, one job per program plus one per kernel for the code.
+     * Each worker compiles with a Slang global session of its own (see
+     * `Device::createSlangGlobalSession()`), so workers don't wait for each other. The global
+     * sessions are created on first use and kept, since kernels of the compiled versions are
+     * created and generated with the global session of their version.
+     * Programs whose active version is compiled already only have their kernels created.
+     * @param[in] programs Programs to compile.
+     * @param[in] parallel Compile on the task scheduler. Otherwise the programs are compiled one
+     * after the other on the calling thread.
+     * @return Results in the order of `programs`.
+     */
+    std::vector<BatchResult> compileBatch(const std::vector<ref<Program>>& programs, bool parallel = true);
+
+    /**
+     * Get a program version that was scheduled for precompiling from the permutation manifest.
+     * Threads outside the task scheduler wait for the version before taking the version lock (see
+     * `Program::waitForPrecompiledVersion()`). Workers run the precompile themselves if it is still
+     * queued, or wait for the worker running it, which compiles from a copy of the program and
+     * doesn't need its lock. Used by `Program::updateActiveVersion()`.
+     * @param[in] fingerprint Version fingerprint (see `Program::getVersionFingerprint()`).
+     * @return The precompiled version, or nullptr if there is none or precompiling failed.
+     */
+    ref<const ProgramVersion> takePrecompiledVersion(const Program& program, const Hash128& fingerprint);
+
+    /**
+     * Compile the version of a program for its current defines and type conformances in the
+     * background, along with its kernels and their code. The version is compiled from a copy of
+     * the program, which it keeps alive, and requests are compiled before permutations from the
+     * permutation manifest.
+     * Used by `Program::requestActiveVersion()`.
+     * @return Future holding the version, or nullptr if compiling failed or was cancelled.
+     */
+    std::shared_future<ref<const ProgramVersion>> requestProgramVersion(const Program& program);
+
+    /**
+     * Record the time from a version request to the swap of the version. Used by `Program`.
+     */
+    void recordVersionSwap(double time);
 
+    /**
+     * Create the kernels of a program version specialized with a set of type conformances.
+     * Use `ProgramVersion::getKernels()` to get memoized kernels instead of calling this directly.
+     * Can be called from several threads, like `createProgramVersion()`.
+     * @param[in] typeConformances Global type conformances. The type conformances of each entry point group are added to these.
+     */
     ref<const ProgramKernels> createProgramKernels(
         const Program& program,
         const ProgramVersion& programVersion,
+        const TypeConformanceList& typeConformances,
         std::string& log
     ) const;
 
@@ -62,12 +193,74 @@ public:
 
     /**
      * Set whether to turn off spirv-direct backend.
+     * All programs are reloaded if the mode changes.
      * @param[in] enable Enable or disable.
      */
-    void setSpirvDirectMode(bool enable) {m_enableSpirvDirect = enable;}
+    void setSpirvDirectMode(bool enable);
+
+    bool isSpirvDirectMode() const { return m_enableSpirvDirect; }
+
+    /**
+     * Code generation target compiled in addition to the device target.
+     */
+    struct AdditionalTarget
+    {
+        SlangCompileTarget format = SLANG_SPIRV;
+        bool spirvDirect = false; ///< Generate SPIR-V directly instead of through glslang.
+    };
+
+    /**
+     * Set targets to compile for in addition to the device target.
+     * The targets are added to the Slang sessions after the device target, so target `i` of
+     * the list has index `i + 1` in `EntryPointKernel::getTargetBlobData()`. Programs are parsed
+     * and checked once for all targets, only code generation is done per target.
+     * All programs are reloaded if the targets change.
+     */
+    void setAdditionalTargets(const std::vector<AdditionalTarget>& targets);
+
+    const std::vector<AdditionalTarget>& getAdditionalTargets() const { return mAdditionalTargets; }
+
+    /**
+     * Set whether to create program versions with the deprecated compile request API
+     * (`spCompile()` with one translation unit per shader module) instead of loading the
+     * shader modules into a session with `ISession::loadModuleFromSource()`.
+     * Programs with shader modules made of several sources always use compile requests.
+     * All programs are reloaded if the mode changes.
+     * @param[in] enable Enable or disable.
+     */
+    void setCompileRequestMode(bool enable);
+
+    bool isCompileRequestMode() const { return mUseCompileRequest; }
+
+    /**
+     * Set the linking style used by programs that don't specify one in their description.
+     * With `ProgramLinkingStyle::WholeProgram`, the entry points of a program share one
+     * linked global scope and their kernel code is generated as a single module.
+     * All programs are reloaded if the style changes.
+     * @param[in] style Linking style. Must not be `ProgramLinkingStyle::Default`.
+     */
+    void setLinkingStyle(ProgramLinkingStyle style);
+
+    ProgramLinkingStyle getLinkingStyle() const { return mLinkingStyle; }
+
+    /**
+     * Set whether program kernels only carry kernel code.
+     * In this mode, creating kernels skips the composition of the specialized program, the
+     * reflection of the specialized program and the creation of the gfx program, which are
+     * only needed for binding parameters and creating pipelines. Kernels use the reflection of
+     * the unspecialized program and `ProgramKernels::getGfxProgram()` returns nullptr.
+     * Intended for precompiling kernels and warming the shader cache, which only need code.
+     * All programs are reloaded if the mode changes.
+     * @param[in] enable Enable or disable.
+     */
+    void setKernelCodeOnlyMode(bool enable);
+
+    bool isKernelCodeOnlyMode() const { return mKernelCodeOnly; }
 
     /**
      * Reload and relink all programs.
+     * Without `forceReload`, only programs with source files (including imported and included
+     * files) that changed since they were compiled are reloaded.
      * @param[in] forceReload Force reloading all programs.
      * @return True if any program was reloaded, false otherwise.
      */
@@ -75,21 +268,25 @@ public:
 
     /**
      * Add a list of defines applied to all programs.
+     * Only programs whose source files reference one of the changed macros are reloaded.
      * @param[in] defineList List of macro definitions.
+     * @return Number of programs kept and rebuilt.
      */
-    void addGlobalDefines(const DefineList& defineList);
+    ReloadResult addGlobalDefines(const DefineList& defineList);
 
     /**
      * Remove a list of defines applied to all programs.
+     * Only programs whose source files reference one of the removed macros are reloaded.
      * @param[in] defineList List of macro definitions.
+     * @return Number of programs kept and rebuilt.
      */
-    void removeGlobalDefines(const DefineList& defineList);
+    ReloadResult removeGlobalDefines(const DefineList& defineList);
 
     /**
      * Set compiler arguments applied to all programs.
      * @param[in] args Compiler arguments.
      */
-    void setGlobalCompilerArguments(const std::vector<std::string>& args) { mGlobalCompilerArguments = args; }
+    void setGlobalCompilerArguments(const std::vector<std::string>& args);
 
     /**
      * Get compiler arguments applied to all programs.
@@ -112,10 +309,12 @@ public:
     /**
      * Sets compiler flags that will always be forced on and forced off on each program.
      * If a flag is in both groups, it results in being forced on.
+     * Only programs whose effective compiler flags change are reloaded.
      * @param[in] forceOn Flags to be forced on.
      * @param[in] forceOff Flags to be forced off.
+     * @return Number of programs kept and rebuilt.
      */
-    void setForcedCompilerFlags(ForcedCompilerFlags forcedCompilerFlags);
+    ReloadResult setForcedCompilerFlags(ForcedCompilerFlags forcedCompilerFlags);
 
     /**
      * Retrieve compiler flags that are always forced on all shaders.
@@ -123,22 +322,312 @@ public:
      */
     ForcedCompilerFlags getForcedCompilerFlags();
 
-    const CompilationStats& getCompilationStats() { return mCompilationStats; }
-    void resetCompilationStats() { mCompilationStats = {}; }
+    /**
+     * Configure the persistent shader cache.
+     * Kernel code is looked up in the cache before invoking Slang code generation and stored
+     * after it. The cache key covers macro definitions, type conformances, compiler configuration,
+     * the Slang version and the contents of all source files of the last compile of the program
+     * version, which are recorded in a dependency manifest.
+     * @param[in] desc Shader cache configuration. Caching is disabled if the directory is empty.
+     */
+    void setShaderCache(const ShaderCacheDesc& desc);
+
+    const ShaderCacheDesc& getShaderCacheDesc() const { return mShaderCacheDesc; }
+
+    ShaderCache* getShaderCache() const { return mpShaderCache.get(); }
+
+    /**
+     * Configure the persistent Slang module cache.
+     * Imported modules are serialized as Slang IR after compiling and loaded from the IR
+     * instead of being parsed and checked again by later compiles. A cached module is used
+     * if its source files and the values of the macros referenced by them are unchanged.
+     * @param[in] directory Cache directory. Module caching is disabled if this is empty.
+     */
+    void setModuleCache(const std::filesystem::path& directory);
+
+    SlangModuleCache* getModuleCache() const { return mpModuleCache.get(); }
+
+    /**
+     * Get the store holding the kernel code of all kernels created by this program manager.
+     */
+    CodeBlobStore& getCodeBlobStore() { return mCodeBlobStore; }
+
+    /**
+     * Set the maximum number of Slang sessions kept for reuse.
+     * Compile requests with the same session configuration (search paths, target, floating point
+     * mode, matrix layout, macros and compiler arguments) share a session, so modules imported by
+     * one program are not loaded again by the next. The least recently used session is evicted
+     * when the pool is full. All pooled sessions are released when programs are reloaded.
+     * @param[in] size Maximum number of pooled sessions. Pooling is disabled if zero.
+     */
+    void setSessionPoolSize(size_t size);
+
+    size_t getSessionPoolSize() const { return mSessionPoolSize; }
+
+    /**
+     * Configure the permutation manifest.
+     * Every program version compiled is recorded in the manifest file (program description,
+     * macro definitions and type conformances). When a program is created, the permutations
+     * recorded for its description are compiled by the task scheduler, so that
+     * `Program::getActiveVersion()` doesn't need to compile them when they are requested.
+     * Programs with the same description share the precompile of a permutation and its version.
+     * Background compiles use the Slang global sessions of the workers, so they don't hold up
+     * foreground compiles. Changing the compiler configuration cancels pending precompiles. Code generation done by
+     * gfx (e.g. when creating pipelines) is not serialized with precompiles, call
+     * `waitForPrecompile()` first if precompiles may still be running.
+     * @param[in] path Manifest file. Recording and precompiling is disabled if empty.
+     */
+    void setPermutationManifest(const std::filesystem::path& path);
+
+    PermutationManifest* getPermutationManifest() const { return mpPermutationManifest.get(); }
+
+    /**
+     * Wait until all scheduled precompiles have finished.
+     */
+    void waitForPrecompile();
+
+    /**
+     * Set the memory budget for compiled program versions of all programs.
+     * When the approximate memory of all program versions and their memoized kernels exceeds
+     * the budget, the least recently activated versions are released, except for the active
+     * version of each program. If that isn't enough, the memoized kernels of the remaining
+     * versions are trimmed, least recently activated versions first. Released versions are
+     * compiled again (or loaded from the shader cache) when they are activated again.
+     * See `ProgramVersion::getApproximateSize()` for how memory is estimated.
+     * @param[in] bytes Budget in bytes. The budget is unlimited if zero.
+     */
+    void setProgramVersionBudget(size_t bytes);
+
+    size_t getProgramVersionBudget() const { return mProgramVersionBudget; }
+
+    /**
+     * Mark a program version as used and enforce the memory budget. Used by `Program::getActiveVersion()`.
+     * @param[in] fingerprint Version fingerprint (see `Program::getVersionFingerprint()`).
+     */
+    void touchProgramVersion(const Program& program, const Hash128& fingerprint, const ProgramVersion* pVersion);
+
+    /**
+     * Stop tracking the program versions of a program. Used when a program is reset or destroyed.
+     */
+    void forgetProgramVersions(const Program& program);
+
+    /**
+     * Get a snapshot of the compilation statistics. Can be called while other threads compile.
+     */
+    CompilationStats getCompilationStats();
+    void resetCompilationStats();
 
 private:
-    SlangCompileRequest* createSlangCompileRequest(const Program& program) const;
+    /**
+     * Output of the Slang front-end for a program version.
+     */
+    struct FrontEndResult
+    {
+        Slang::ComPtr<slang::IComponentType> pSlangGlobalScope;
+        std::vector<Slang::ComPtr<slang::IComponentType>> pSlangEntryPoints; ///< Indexed by global entry point index.
+        std::vector<std::string> dependencyPaths;                             ///< Source files read by Slang.
+    };
+
+    struct SlangContext;
+
+    Slang::ComPtr<slang::ISession> createSlangSession(const Program& program, SlangContext& context, bool useCompileRequest) const;
+    SlangCompileRequest* createSlangCompileRequest(const Program& program, slang::ISession* pSlangSession) const;
+    bool runFrontEndWithCompileRequest(const Program& program, SlangContext& context, FrontEndResult& result, std::string& log) const;
+    bool runFrontEndWithSession(const Program& program, SlangContext& context, FrontEndResult& result, std::string& log) const;
+    bool canUseSessionFrontEnd(const Program& program) const;
+    /**
+     * Create a program version. Must be called with the lock of the Slang context held.
+     */
+    ref<const ProgramVersion> createProgramVersionImpl(const Program& program, uint32_t slangContext, std::string& log) const;
+
+    /**
+     * Get a Slang context. There is one context per worker of the task scheduler after context 0,
+     * created with the program manager and never destroyed.
+     */
+    SlangContext& getSlangContext(uint32_t index) const { return *mSlangContexts[index]; }
+    uint32_t getSlangContextCount() const { return uint32_t(mSlangContexts.size()); }
+
+    /**
+     * Get the Slang context of the calling thread, creating its global session on first use.
+     * @return The context of the task scheduler worker running the calling thread, or 0 for other threads.
+     */
+    uint32_t getWorkerSlangContext() const;
+    void recordPermutation(const Program& program) const;
+
+    /**
+     * Release program versions until the resident versions fit into the budget. Must be called with `mResidentMutex` held.
+     * Programs other than `pLockedProgram` are skipped if another thread holds their version lock.
+     * @param[in] pLockedProgram Program whose version lock is held by the caller, if any.
+     */
+    void enforceProgramVersionBudget(const Program* pLockedProgram = nullptr);
+
+    void recordProgramVersionTime(double time, bool cacheHit) const;
+    void recordProgramKernelsTime(double time) const;
+    EntryPointKernel::CodegenCallback getCodegenCallback() const;
+
+    void schedulePrecompile(Program& program);
+    struct PrecompileTask;
+    /**
+     * Queue a precompile and submit a job to the task scheduler running it. Jobs run the precompile
+     * at the front of the queue, so precompiles start in queue order. A permutation that is
+     * already queued or running isn't queued again, its future is returned instead. A request
+     * moves a queued precompile of the same permutation to the front.
+     * @param[in] pProgram Copy of a program with the defines and type conformances of the permutation.
+     * @param[in] request Generate the kernel code too, and compile before the queued precompiles.
+     */
+    std::shared_future<ref<const ProgramVersion>> queuePrecompile(ref<Program> pProgram, bool request);
+    void cancelPrecompile();
+    void runPrecompileTask();
+    /**
+     * Run a queued precompile on the calling thread instead of waiting for a worker to start it.
+     * Does nothing if the precompile is running or finished.
+     */
+    void runQueuedPrecompile(const Hash128& key);
+    void runPrecompile(PrecompileTask& task);
+    /**
+     * Remove a finished precompile. Must be called with mPrecompileMutex held.
+     */
+    void finishPrecompile(const std::shared_ptr<PrecompileTask>& pTask);
+
+    ReloadResult reloadPrograms(const std::function<bool(Program&)>& needsReload);
+    ReloadResult reloadProgramsReferencingGlobalDefines(const DefineList& oldGlobalDefineList);
+    bool mayReferenceMacros(const Program& program, const std::vector<std::string>& names) const;
+
+    Slang::ComPtr<slang::ISession> acquireSession(SlangContext& context, const slang::SessionDesc& sessionDesc, const Hash128& key) const;
+    void flushSessionPool();
+
+    /**
+     * Get the composite component type of a list of type conformances.
+     * Composites and the type conformance components they are made of are cached per session,
+     * keyed by the types found in the global scope. The composites of the last global scope are
+     * also cached by type conformance list, so the entry point groups of a program version and
+     * repeated kernel creation for it don't search the global scope again.
+     * @param[in] pSlangGlobalScope Global scope the types are looked up in.
+     * @return The composite, which is null for an empty list, or nothing if a type or interface was not found.
+     */
+    std::optional<Slang::ComPtr<slang::IComponentType>> getTypeConformanceComposite(
+        SlangContext& context,
+        slang::IComponentType* pSlangGlobalScope,
+        const TypeConformanceList& typeConformances,
+        std::string& log
+    ) const;
+
+    SlangCompilerFlags getCompilerFlags(const Program& program) const;
+    SlangCompilerFlags getCompilerFlags(const Program& program, const ForcedCompilerFlags& forcedCompilerFlags) const;
+    DefineList getSessionDefines(const Program& program) const;
+    ProgramLinkingStyle getLinkingStyle(const Program& program) const;
+    uint32_t getTargetCount() const { return 1 + uint32_t(mAdditionalTargets.size()); }
+
+    void hashCompilerConfiguration(Hasher& hasher, const Program& program) const;
+    Hash128 computeSessionCacheKey(const Program& program) const;
+
+    Hash128 computeProgramVersionLookupKey(const Program& program) const;
+    bool loadDependencyManifest(const Hash128& lookupKey, ShaderFileDependencyList& dependencies) const;
+    void storeDependencyManifest(const Hash128& lookupKey, const ShaderFileDependencyList& dependencies) const;
+    void collectFileDependencies(const std::vector<std::string>& paths, ShaderFileDependencyList& dependencies) const;
+    ref<const ProgramKernels> createCacheBackedProgramKernels(
+        const Program& program,
+        const ProgramVersion& programVersion,
+        const TypeConformanceList& typeConformances
+    ) const;
 
     Device* mpDevice;
 
+    // Locks are taken in this order: mLoadedProgramsMutex, the version lock of a program
+    // (`Program::mVersionMutex`), mResidentMutex, the lock of a Slang context, mCacheMutex or
+    // mGfxMutex, mStatsMutex. Configuration setters must not be called while other threads compile.
+
     std::vector<Program*> mLoadedPrograms;
+    std::mutex mLoadedProgramsMutex; ///< Guards mLoadedPrograms.
     mutable CompilationStats mCompilationStats;
+    mutable std::mutex mStatsMutex; ///< Guards mCompilationStats, so statistics don't wait for compiles.
 
     DefineList mGlobalDefineList;
     std::vector<std::string> mGlobalCompilerArguments;
     bool mGenerateDebugInfo = false;
     ForcedCompilerFlags mForcedCompilerFlags;
 
-    mutable uint32_t mHitGroupID = 0;
+    Slang::ComPtr<DependencyTrackingFileSystem> mpFileSystem;
+    mutable ShaderFileInfoCache mFileInfoCache; ///< Identifiers of source files, used to find the programs affected by a macro.
+
+    ShaderCacheDesc mShaderCacheDesc;
+    std::unique_ptr<ShaderCache> mpShaderCache;
+    std::unique_ptr<ShaderCache> mpManifestCache; ///< Dependency manifests of program versions, next to the shader cache.
+    std::unique_ptr<SlangModuleCache> mpModuleCache;
+    mutable CodeBlobStore mCodeBlobStore; ///< Kernel code shared by all kernels, deduplicated by content.
+
+    struct PooledSession
+    {
+        Hash128 key;
+        Slang::ComPtr<slang::ISession> pSession;
+    };
+    size_t mSessionPoolSize = 8; ///< Per Slang context.
+
+    struct SessionTypeConformances
+    {
+        Slang::ComPtr<slang::ISession> pSession;
+        std::unordered_map<Hash128, Slang::ComPtr<slang::ITypeConformance>, Hash128::HashFunction> components; ///< By resolved type, interface and ID.
+        std::unordered_map<Hash128, Slang::ComPtr<slang::IComponentType>, Hash128::HashFunction> composites; ///< By resolved type conformance list.
+        /// Global scope the types were last looked up in. Holding it keeps its address from being reused.
+        Slang::ComPtr<slang::IComponentType> pGlobalScope;
+        /// Composites of the lists looked up in `pGlobalScope`, by type conformance list (see `hashTypeConformanceList()`).
+        std::unordered_map<Hash128, Slang::ComPtr<slang::IComponentType>, Hash128::HashFunction> globalScopeComposites;
+    };
+
+    /**
+     * A Slang global session and the state used together with it. A global session and all
+     * objects created from it must only be used by one thread at a time, which is ensured by
+     * holding `mutex`. Context 0 holds the global session of the device.
+     */
+    struct SlangContext
+    {
+        Slang::ComPtr<slang::IGlobalSession> pGlobalSession;
+        std::mutex mutex;
+        std::list<PooledSession> sessionPool; ///< Pooled sessions, most recently used first.
+        /// Type conformance components per session, most recently used first. Holds as many sessions as the session pool (at least one).
+        std::list<SessionTypeConformances> typeConformanceCache;
+    };
+    std::vector<std::unique_ptr<SlangContext>> mSlangContexts;
+
+    struct ResidentVersion
+    {
+        const Program* pProgram;
+        Hash128 fingerprint;
+        const ProgramVersion* pVersion;
+    };
+    std::list<ResidentVersion> mResidentVersions; ///< Program versions held by programs, most recently activated first.
+    /// Resident versions by program and version. Precompiled versions can be shared by programs with the same description.
+    std::map<std::pair<const Program*, const ProgramVersion*>, std::list<ResidentVersion>::iterator> mResidentVersionMap;
+    std::mutex mResidentMutex; ///< Guards the resident versions.
+    size_t mProgramVersionBudget = 0;
+
+    /// Guards the module cache, the dependency manifests and the permutation manifest, which are shared by all Slang contexts.
+    mutable std::mutex mCacheMutex;
+    /// Serializes the creation of gfx programs, the gfx device is not thread-safe.
+    mutable std::mutex mGfxMutex;
+
+    struct PrecompileTask
+    {
+        ref<Program> pProgram; ///< Copy of a program with the defines and type conformances of the permutation.
+        std::promise<ref<const ProgramVersion>> promise;
+        std::shared_future<ref<const ProgramVersion>> future;
+        Hash128 key;          ///< Program description key and version fingerprint (see computePermutationKey()).
+        bool request = false; ///< Requested by `Program::requestActiveVersion()`, the kernel code is generated too.
+        bool running = false;
+    };
+    std::unique_ptr<PermutationManifest> mpPermutationManifest;
+    std::deque<std::shared_ptr<PrecompileTask>> mPrecompileQueue;
+    std::mutex mPrecompileMutex; ///< Guards the precompile queue and state below.
+    std::condition_variable mPrecompileCondition;
+    size_t mPrecompileJobs = 0;    ///< Precompile jobs submitted to the task scheduler that didn't finish.
+    size_t mPrecompilesRunning = 0; ///< Precompiles in flight.
+    /// Queued and running precompiles by key. Programs with the same description share them.
+    std::unordered_map<Hash128, std::shared_ptr<PrecompileTask>, Hash128::HashFunction> mPrecompiles;
+
+    mutable std::atomic<uint32_t> mHitGroupID{0};
     bool m_enableSpirvDirect = false;
+    bool mUseCompileRequest = false;
+    ProgramLinkingStyle mLinkingStyle = ProgramLinkingStyle::SeparateEntryPoints;
+    bool mKernelCodeOnly = false;
+    std::vector<AdditionalTarget> mAdditionalTargets;
 };
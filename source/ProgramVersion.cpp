@@ -3,13 +3,155 @@
  # Copyright 2024 The Khronos Group, Inc.
  # Copyright 2024 The Khronos Group, Inc.
  **************************************************************************/
+#include <atomic>
 #include <set>
 #include <slang.h>
 
 #include "ProgramVersion.h"
 #include "Program.h"
+#include "CodeBlobStore.h"
+#include "CpuTimer.h"
+#include "TaskScheduler.h"
 #include "Utility.h"
 
+namespace
+{
+/// Estimated memory of a program version without its Slang objects (reflection, names, bookkeeping).
+const size_t kProgramVersionBaseSize = 64 * 1024;
+/// Estimated bytes of Slang AST and IR per byte of source code.
+const size_t kSlangBytesPerSourceByte = 8;
+} // namespace
+
+Hash128 EntryPointKernel::computeTargetCacheKey(const Hash128& cacheKey, uint32_t targetIndex)
+{
+    if (targetIndex == 0 || cacheKey.isZero())
+        return cacheKey;
+    Hasher hasher;
+    hasher.update(cacheKey);
+    hasher.update(targetIndex);
+    return hasher.getDigest();
+}
+
+size_t EntryPointKernel::getCodeSize() const
+{
+    return mCodeSize;
+}
+
+double EntryPointKernel::getCodegenTime() const
+{
+    return double(mCodegenTimeNs) * 1.0e-9;
+}
+
+EntryPointKernel::BlobData EntryPointKernel::getTargetBlobData(uint32_t targetIndex) const
+{
+    if (targetIndex >= mTargetCount)
+    {
+        printf("Entry point '%s' has no code for target %u.\n", mEntryPointName.c_str(), targetIndex);
+        assert(0);
+        return BlobData{nullptr, 0};
+    }
+
+    // Callers only wait for the code of the same target. The shader cache entry lock and Slang code
+    // generation are not held by a lock the statistics take.
+    TargetCode& target = mTargets[targetIndex];
+    std::call_once(
+        target.once,
+        [&]()
+        {
+            target.pCode = loadOrGenerateCode(targetIndex);
+            if (target.pCode)
+                mCodeSize += target.pCode->data.size();
+        }
+    );
+    if (!target.pCode)
+        return BlobData{nullptr, 0};
+
+    BlobData result;
+    result.data = target.pCode->data.data();
+    result.size = target.pCode->data.size();
+    return result;
+}
+
+std::shared_ptr<const CodeBlob> EntryPointKernel::loadOrGenerateCode(uint32_t targetIndex) const
+{
+    // Only Slang code generation holds the compile lock, so kernels sharing a Slang global
+    // session can load and store their code concurrently.
+    std::shared_ptr<const CodeBlob> pCode;
+    const Hash128 cacheKey = computeTargetCacheKey(mCacheKey, targetIndex);
+    const bool useShaderCache = mpCodeBlobStore && !cacheKey.isZero();
+    if (useShaderCache)
+        pCode = mpCodeBlobStore->loadKernel(cacheKey);
+
+    // Another process sharing the shader cache may be generating the same code. Hold the entry
+    // lock while generating, and use the code of the other process if it stored it meanwhile.
+    ShaderCache::EntryLock entryLock;
+    if (!pCode && useShaderCache && mLinkedSlangEntryPoint)
+    {
+        entryLock = mpCodeBlobStore->lockKernel(cacheKey);
+        if (mpCodeBlobStore->containsKernel(cacheKey))
+            pCode = mpCodeBlobStore->loadKernel(cacheKey);
+    }
+
+    if (!pCode && !mLinkedSlangEntryPoint)
+    {
+        // Kernels of cache-backed program versions can't fall back to Slang.
+        printf("Shader cache entry %s for entry point '%s' is missing.\n", cacheKey.toString().c_str(), mEntryPointName.c_str());
+        assert(0);
+        return nullptr;
+    }
+
+    if (!pCode)
+    {
+        CpuTimer timer;
+        timer.update();
+
+        // Slang keeps the code of the whole program, so it is only generated for the first of its kernels.
+        Slang::ComPtr<ISlangBlob> pBlob;
+        Slang::ComPtr<ISlangBlob> pDiagnostics;
+        SlangResult result;
+        {
+            std::unique_lock<std::mutex> lock;
+            if (mpCompileMutex)
+                lock = std::unique_lock<std::mutex>(*mpCompileMutex);
+            result = mWholeProgram ? mLinkedSlangEntryPoint->getTargetCode(targetIndex, pBlob.writeRef(), pDiagnostics.writeRef())
+                                   : mLinkedSlangEntryPoint->getEntryPointCode(0, targetIndex, pBlob.writeRef(), pDiagnostics.writeRef());
+        }
+        if (SLANG_FAILED(result))
+        {
+            std::string msg = (std::string("Shader compilation failed. \n") + (const char*)pDiagnostics->getBufferPointer());
+            printf("%s\n", msg.c_str());
+            assert(0);
+            return nullptr;
+        }
+
+        const void* pData = pBlob->getBufferPointer();
+        size_t size = pBlob->getBufferSize();
+
+        timer.update();
+        mCodegenTimeNs += uint64_t(timer.delta() * 1.0e9);
+        if (mCodegenCallback)
+            mCodegenCallback(targetIndex, timer.delta(), size);
+
+        if (useShaderCache)
+        {
+            pCode = mpCodeBlobStore->storeKernel(cacheKey, pData, size);
+        }
+        else if (mpCodeBlobStore)
+        {
+            pCode = mpCodeBlobStore->add(pData, size);
+        }
+        else
+        {
+            auto pNewCode = std::make_shared<CodeBlob>();
+            pNewCode->hash = hash128(pData, size);
+            pNewCode->data.assign(static_cast<const uint8_t*>(pData), static_cast<const uint8_t*>(pData) + size);
+            pCode = pNewCode;
+        }
+    }
+
+    return pCode;
+}
+
 
 ref<const EntryPointGroupKernels> EntryPointGroupKernels::create(
     EntryPointGroupKernels::Type type,
@@ -47,6 +189,52 @@ ProgramKernels::ProgramKernels(
     : mName(name), mUniqueEntryPointGroups(uniqueEntryPointGroups), mpReflector(pReflector), mpVersion(pVersion)
 {}
 
+bool ProgramKernels::generateAll(TaskScheduler* pScheduler) const
+{
+    std::vector<const EntryPointKernel*> kernels;
+    for (const auto& pGroup : mUniqueEntryPointGroups)
+    {
+        for (size_t i = 0; i < pGroup->getKernelCount(); i++)
+            kernels.push_back(pGroup->getKernelByIndex(i));
+    }
+
+    std::atomic<bool> success{true};
+    auto generate = [&success](const EntryPointKernel* pKernel, uint32_t targetIndex)
+    {
+        if (pKernel->getTargetBlobData(targetIndex).data == nullptr)
+            success = false;
+    };
+
+    if (!pScheduler)
+    {
+        for (const EntryPointKernel* pKernel : kernels)
+        {
+            for (uint32_t targetIndex = 0; targetIndex < pKernel->getTargetCount(); targetIndex++)
+                generate(pKernel, targetIndex);
+        }
+        return success;
+    }
+
+    std::vector<TaskScheduler::TaskHandle> tasks;
+    std::vector<TaskScheduler::TaskHandle> wholeProgramTasks; ///< Job of the first whole-program kernel per target.
+    for (const EntryPointKernel* pKernel : kernels)
+    {
+        for (uint32_t targetIndex = 0; targetIndex < pKernel->getTargetCount(); targetIndex++)
+        {
+            std::vector<TaskScheduler::TaskHandle> dependencies;
+            if (pKernel->isWholeProgram() && targetIndex < wholeProgramTasks.size())
+                dependencies.push_back(wholeProgramTasks[targetIndex]);
+            tasks.push_back(pScheduler->submit(
+                "generateKernelCode", [&generate, pKernel, targetIndex]() { generate(pKernel, targetIndex); }, dependencies
+            ));
+            if (pKernel->isWholeProgram() && targetIndex == wholeProgramTasks.size())
+                wholeProgramTasks.push_back(tasks.back());
+        }
+    }
+    pScheduler->wait(tasks);
+    return success;
+}
+
 ref<ProgramKernels> ProgramKernels::create(
     Device* pDevice,
     const ProgramVersion* pVersion,
@@ -55,13 +243,17 @@ ref<ProgramKernels> ProgramKernels::create(
     const ref<const ProgramReflection>& pReflector,
     const ProgramKernels::UniqueEntryPointGroups& uniqueEntryPointGroups,
     std::string& log,
-    const std::string& name
+    const std::string& name,
+    ProgramLinkingStyle linkingStyle
 )
 {
+    ASSERT(linkingStyle != ProgramLinkingStyle::Default);
     ref<ProgramKernels> pProgram = ref<ProgramKernels>(new ProgramKernels(pVersion, pReflector, uniqueEntryPointGroups, name));
 
     gfx::IShaderProgram::Desc programDesc = {};
-    programDesc.linkingStyle = gfx::IShaderProgram::LinkingStyle::SeparateEntryPointCompilation;
+    programDesc.linkingStyle = linkingStyle == ProgramLinkingStyle::WholeProgram
+                                   ? gfx::IShaderProgram::LinkingStyle::SingleProgram
+                                   : gfx::IShaderProgram::LinkingStyle::SeparateEntryPointCompilation;
     programDesc.slangGlobalScope = pSpecializedSlangGlobalScope;
 
     // Check if we are creating program kernels for ray tracing pipeline.
@@ -119,6 +311,16 @@ ref<ProgramKernels> ProgramKernels::create(
     return pProgram;
 }
 
+ref<ProgramKernels> ProgramKernels::createCodeOnly(
+    const ProgramVersion* pVersion,
+    const ref<const ProgramReflection>& pReflector,
+    const ProgramKernels::UniqueEntryPointGroups& uniqueEntryPointGroups,
+    const std::string& name
+)
+{
+    return ref<ProgramKernels>(new ProgramKernels(pVersion, pReflector, uniqueEntryPointGroups, name));
+}
+
 const EntryPointKernel* ProgramKernels::getKernel(ShaderType type) const
 {
     for (auto& pEntryPointGroup : mUniqueEntryPointGroups)
@@ -135,6 +337,8 @@ ProgramVersion::ProgramVersion(Program* pProgram, slang::IComponentType* pSlangG
     ASSERT(pProgram);
 }
 
+ProgramVersion::~ProgramVersion() = default;
+
 void ProgramVersion::init(
     const DefineList& defineList,
     const ref<const ProgramReflection>& pReflector,
@@ -154,66 +358,96 @@ ref<ProgramVersion> ProgramVersion::createEmpty(Program* pProgram, slang::ICompo
     return ref<ProgramVersion>(new ProgramVersion(pProgram, pSlangGlobalScope));
 }
 
-// ref<const ProgramKernels> ProgramVersion::getKernels(Device* pDevice, ProgramVars const* pVars) const
-// {
-//     // We need are going to look up or create specialized kernels
-//     // based on how parameters are bound in `pVars`.
-//     //
-//     // To do this we need to identify those parameters that are relevant
-//     // to specialization, and what argument type/value is bound to
-//     // those parameters.
-//     //
-//     std::string specializationKey;
-//
-//     ParameterBlock::SpecializationArgs specializationArgs;
-//     if (pVars)
-//     {
-//         pVars->collectSpecializationArgs(specializationArgs);
-//     }
-//
-//     bool first = true;
-//     for (auto specializationArg : specializationArgs)
-//     {
-//         if (!first)
-//             specializationKey += ",";
-//         specializationKey += std::string(specializationArg.type->getName());
-//         first = false;
-//     }
-//
-//     auto foundKernels = mpKernels.find(specializationKey);
-//     if (foundKernels != mpKernels.end())
-//     {
-//         return foundKernels->second;
-//     }
-//
-//     assert(!mpProgram);
-//
-//     // Loop so that user can trigger recompilation on error
-//     for (;;)
-//     {
-//         std::string log;
-//         auto pKernels = pDevice->getProgramManager()->createProgramKernels(*mpProgram, *this, *pVars, log);
-//         if (pKernels)
-//         {
-//             // Success
-//
-//             if (!log.empty())
-//             {
-//                 printf("Warnings in program:\n%s\n%s", getName().c_str(), log.c_str());
-//             }
-//
-//             mpKernels[specializationKey] = pKernels;
-//             return pKernels;
-//         }
-//         else
-//         {
-//             // Failure
-//             std::string msg = std::string("Failed to link program:\n") + getName() + std::string("\n")+log;
-//             printf("%s\n", msg.c_str());
-//             assert(0);
-//         }
-//     }
-// }
+ref<const ProgramKernels> ProgramVersion::getKernels(const TypeConformanceList& typeConformances, std::string* pLog) const
+{
+    Hasher hasher;
+    hashTypeConformanceList(hasher, typeConformances);
+    Hash128 fingerprint = hasher.getDigest();
+
+    {
+        std::lock_guard<std::mutex> lock(mKernelsMutex);
+        auto foundKernels = mpKernels.find(fingerprint);
+        if (foundKernels != mpKernels.end())
+        {
+            mKernelsLru.splice(mKernelsLru.begin(), mKernelsLru, foundKernels->second);
+            return foundKernels->second->pKernels;
+        }
+    }
+
+    ASSERT(mpProgram);
+
+    // Kernels are created without holding the lock. If another thread created the same
+    // specialization in the meantime, we use its kernels.
+    std::string log;
+    auto pKernels = mpProgram->mpDevice->getProgramManager()->createProgramKernels(*mpProgram, *this, typeConformances, log);
+    if (!pKernels)
+    {
+        std::string msg = std::string("Failed to link program:\n") + getName() + std::string("\n") + log;
+        if (pLog)
+        {
+            *pLog += msg;
+            return nullptr;
+        }
+        printf("%s\n", msg.c_str());
+        assert(0);
+        return nullptr;
+    }
+    if (!log.empty())
+    {
+        if (pLog)
+            *pLog += log;
+        else
+            printf("Warnings in program:\n%s\n%s", getName().c_str(), log.c_str());
+    }
+
+    std::lock_guard<std::mutex> lock(mKernelsMutex);
+    auto foundKernels = mpKernels.find(fingerprint);
+    if (foundKernels != mpKernels.end())
+        return foundKernels->second->pKernels;
+
+    mKernelsLru.push_front({fingerprint, pKernels});
+    mpKernels[fingerprint] = mKernelsLru.begin();
+    if (mKernelsLru.size() > kMaxCachedKernels)
+    {
+        mpKernels.erase(mKernelsLru.back().fingerprint);
+        mKernelsLru.pop_back();
+    }
+    return pKernels;
+}
+
+size_t ProgramVersion::trimKernels(size_t keepCount) const
+{
+    std::lock_guard<std::mutex> lock(mKernelsMutex);
+    size_t count = 0;
+    while (mKernelsLru.size() > keepCount)
+    {
+        mpKernels.erase(mKernelsLru.back().fingerprint);
+        mKernelsLru.pop_back();
+        count++;
+    }
+    return count;
+}
+
+size_t ProgramVersion::getApproximateSize() const
+{
+    size_t size = kProgramVersionBaseSize;
+    if (!isCacheBacked())
+    {
+        for (const auto& dependency : mFileDependencies)
+            size += size_t(dependency.size) * kSlangBytesPerSourceByte;
+    }
+
+    std::lock_guard<std::mutex> lock(mKernelsMutex);
+    for (const auto& cachedKernels : mKernelsLru)
+    {
+        for (const auto& pGroup : cachedKernels.pKernels->getUniqueEntryPointGroups())
+        {
+            for (size_t i = 0; i < pGroup->getKernelCount(); ++i)
+                size += pGroup->getKernelByIndex(i)->getCodeSize();
+        }
+    }
+    return size;
+}
 
 slang::ISession* ProgramVersion::getSlangSession() const
 {
@@ -3,7 +3,11 @@
  # Copyright 2024 The Khronos Group, Inc.
  **************************************************************************/
 #pragma once
+#include <atomic>
+#include <functional>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -13,14 +17,30 @@
 #include <slang-com-ptr.h>
 #include <slang-gfx.h>
 #include "DefineList.h"
+#include "Hash.h"
 #include "Object.h"
+#include "ShaderFileInfo.h"
 #include "Types.h"
 
 class Device;
+class CodeBlobStore;
+struct CodeBlob;
 class ProgramReflection;
 class ProgramVersion;
 class Program;
 class ProgramVars;
+class TypeConformanceList;
+class TaskScheduler;
+
+/**
+ * Kernel code generation statistics of a target.
+ */
+struct TargetCodegenStats
+{
+    size_t kernelCount = 0; ///< Kernels generated by Slang.
+    double time = 0.0;      ///< Total code generation time in seconds.
+    uint64_t bytes = 0;     ///< Total size of the generated code.
+};
 
 /**
  * Represents a single program entry point and its associated kernel code.
@@ -34,6 +54,19 @@ class ProgramVars;
  * Since most users/render-passes do not need to get shader kernel code, we defer
  * the call to slang's `getEntryPointCode` function until it is actually needed.
  * to avoid redundant shader compiler invocation.
+ *
+ * Kernel code is kept in a `CodeBlobStore`, so kernels with identical code share one copy.
+ * If the kernel has a cache key, the code is looked up in the shader cache before invoking
+ * Slang, and newly generated code is written back to it. Kernels created from a
+ * cache-backed `ProgramVersion` have no Slang entry point at all and can only be served
+ * from the cache.
+ *
+ * Sessions can have several targets. Target 0 is the target of the device, the code for the
+ * other targets is generated from the same linked component type with `getTargetBlobData()`.
+ *
+ * With whole-program linking, the kernels of a program share one Slang component type
+ * holding all entry points, and the code of each kernel is the module generated for the
+ * whole program. The entry point is selected by name when creating the pipeline.
  */
 class EntryPointKernel : public Object
 {
@@ -44,21 +77,45 @@ public:
         size_t size;
     };
 
+    /// Called after generating code for a target, with the target index, the code generation time in seconds and the code size.
+    using CodegenCallback = std::function<void(uint32_t targetIndex, double time, uint64_t bytes)>;
+
     /**
      * Create a shader object
      * @param[in] linkedSlangEntryPoint The Slang IComponentType that defines the shader entry point.
      * @param[in] type The Type of the shader
+     * @param[in] pCodeBlobStore Optional store holding the kernel code. Also used to look up and store the code in the shader cache.
+     * @param[in] cacheKey Key of the kernel code in the shader cache. The shader cache is not used if zero.
+     * @param[in] pCompileMutex Optional mutex held while Slang generates the kernel code.
+     * @param[in] wholeProgram If true, `linkedSlangEntryPoint` is the whole program and the code is generated for all of its entry points.
+     * @param[in] targetCount Number of targets of the Slang session.
+     * @param[in] codegenCallback Optional callback reporting the code generated for a target.
      * @return If success, a new shader object, otherwise nullptr
      */
     static ref<EntryPointKernel> create(
         Slang::ComPtr<slang::IComponentType> linkedSlangEntryPoint,
         ShaderType type,
-        const std::string& entryPointName
+        const std::string& entryPointName,
+        CodeBlobStore* pCodeBlobStore = nullptr,
+        const Hash128& cacheKey = {},
+        std::mutex* pCompileMutex = nullptr,
+        bool wholeProgram = false,
+        uint32_t targetCount = 1,
+        CodegenCallback codegenCallback = {}
     )
     {
-        return ref<EntryPointKernel>(new EntryPointKernel(linkedSlangEntryPoint, type, entryPointName));
+        return ref<EntryPointKernel>(new EntryPointKernel(
+            linkedSlangEntryPoint, type, entryPointName, pCodeBlobStore, cacheKey, pCompileMutex, wholeProgram, targetCount,
+            std::move(codegenCallback)
+        ));
     }
 
+    /**
+     * Compute the shader cache key of the code for a target.
+     * The key of target 0 is the key of the kernel.
+     */
+    static Hash128 computeTargetCacheKey(const Hash128& cacheKey, uint32_t targetIndex);
+
     /**
      * Get the shader Type
      */
@@ -69,34 +126,93 @@ public:
      */
     const std::string& getEntryPointName() const { return mEntryPointName; }
 
-    BlobData getBlobData() const
-    {
-        if (!mpBlob)
-        {
-            Slang::ComPtr<ISlangBlob> pDiagnostics;
-            if (SLANG_FAILED(mLinkedSlangEntryPoint->getEntryPointCode(0, 0, mpBlob.writeRef(), pDiagnostics.writeRef())))
-            {
-                std::string msg = (std::string("Shader compilation failed. \n") + (const char*)pDiagnostics->getBufferPointer());
-                printf("%s\n", msg.c_str());
-                assert(0);
-            }
-        }
+    /**
+     * Get the key of the kernel code in the shader cache.
+     */
+    const Hash128& getCacheKey() const { return mCacheKey; }
 
-        BlobData result;
-        result.data = mpBlob->getBufferPointer();
-        result.size = mpBlob->getBufferSize();
-        return result;
-    }
+    /**
+     * Get the kernel code for the device target. The code is generated (or loaded from the shader cache) on first use.
+     */
+    BlobData getBlobData() const { return getTargetBlobData(0); }
+
+    /**
+     * Get the kernel code for a target of the Slang session.
+     * The code is generated (or loaded from the shader cache) on first use.
+     */
+    BlobData getTargetBlobData(uint32_t targetIndex) const;
+
+    /**
+     * True if the code of the kernel is the code of the whole program.
+     */
+    bool isWholeProgram() const { return mWholeProgram; }
+
+    /**
+     * Get the number of targets the kernel has code for.
+     */
+    uint32_t getTargetCount() const { return mTargetCount; }
+
+    /**
+     * Get the size of the kernel code of all targets, not counting code that wasn't generated or loaded yet.
+     */
+    size_t getCodeSize() const;
+
+    /**
+     * Get the time Slang spent generating the code of all targets, in seconds.
+     * Code loaded from the shader cache doesn't count.
+     */
+    double getCodegenTime() const;
 
 protected:
-    EntryPointKernel(Slang::ComPtr<slang::IComponentType> linkedSlangEntryPoint, ShaderType type, const std::string& entryPointName)
-        : mLinkedSlangEntryPoint(linkedSlangEntryPoint), mType(type), mEntryPointName(entryPointName)
+    EntryPointKernel(
+        Slang::ComPtr<slang::IComponentType> linkedSlangEntryPoint,
+        ShaderType type,
+        const std::string& entryPointName,
+        CodeBlobStore* pCodeBlobStore,
+        const Hash128& cacheKey,
+        std::mutex* pCompileMutex,
+        bool wholeProgram,
+        uint32_t targetCount,
+        CodegenCallback codegenCallback
+    )
+        : mLinkedSlangEntryPoint(linkedSlangEntryPoint)
+        , mType(type)
+        , mEntryPointName(entryPointName)
+        , mpCodeBlobStore(pCodeBlobStore)
+        , mCacheKey(cacheKey)
+        , mpCompileMutex(pCompileMutex)
+        , mWholeProgram(wholeProgram)
+        , mTargetCount(targetCount)
+        , mCodegenCallback(std::move(codegenCallback))
+        , mTargets(targetCount)
     {}
 
+    /**
+     * Load the code for a target from the shader cache, or generate it. Called once per target.
+     * @return The code, or nullptr on failure.
+     */
+    std::shared_ptr<const CodeBlob> loadOrGenerateCode(uint32_t targetIndex) const;
+
     Slang::ComPtr<slang::IComponentType> mLinkedSlangEntryPoint;
     ShaderType mType;
     std::string mEntryPointName;
-    mutable Slang::ComPtr<ISlangBlob> mpBlob;
+    CodeBlobStore* mpCodeBlobStore;
+    Hash128 mCacheKey;
+    std::mutex* mpCompileMutex; ///< Serializes Slang code generation with the program manager's compiles.
+    bool mWholeProgram;         ///< The code is generated for the whole program instead of a single entry point.
+    uint32_t mTargetCount;
+    CodegenCallback mCodegenCallback;
+
+    /// Code of a target. The first caller loads or generates it, later callers wait for it.
+    struct TargetCode
+    {
+        std::once_flag once;
+        std::shared_ptr<const CodeBlob> pCode; ///< Written once under `once`.
+    };
+    mutable std::vector<TargetCode> mTargets;
+    /// Read by the statistics without waiting for code generation.
+    mutable std::atomic<size_t> mCodeSize{0};          ///< Size of the code of all targets loaded or generated so far.
+    mutable std::atomic<uint64_t> mCodegenTimeNs{0};   ///< Slang code generation time of all targets, in nanoseconds.
 };
 
 /**
@@ -127,6 +243,7 @@ public:
     Type getType() const { return mType; }
     const EntryPointKernel* getKernel(ShaderType type) const;
     const EntryPointKernel* getKernelByIndex(size_t index) const { return mKernels[index].get(); }
+    size_t getKernelCount() const { return mKernels.size(); }
     const std::string& getExportName() const { return mExportName; }
 
 protected:
@@ -159,6 +276,7 @@ public:
      * @param[in] pDS Domain shader object
      * @param[out] Log In case of error, this will contain the error log string
      * @param[in] DebugName Optional. A meaningful name to use with log messages
+     * @param[in] linkingStyle Linking style of the gfx program. Must not be `ProgramLinkingStyle::Default`.
      * @return New object in case of success, otherwise nullptr
      */
     static ref<ProgramKernels> create(
@@ -169,6 +287,19 @@ public:
         const ref<const ProgramReflection>& pReflector,
         const UniqueEntryPointGroups& uniqueEntryPointGroups,
         std::string& log,
+        const std::string& name = "",
+        ProgramLinkingStyle linkingStyle = ProgramLinkingStyle::SeparateEntryPoints
+    );
+
+    /**
+     * Create a program kernels object that only carries kernel code.
+     * No gfx program is created, `getGfxProgram()` returns nullptr.
+     * This is used for kernels served from the shader cache without running the Slang front-end.
+     */
+    static ref<ProgramKernels> createCodeOnly(
+        const ProgramVersion* pVersion,
+        const ref<const ProgramReflection>& pReflector,
+        const UniqueEntryPointGroups& uniqueEntryPointGroups,
         const std::string& name = ""
     );
 
@@ -195,6 +326,18 @@ public:
 
     const ref<const EntryPointGroupKernels>& getUniqueEntryPointGroup(uint32_t index) const { return mUniqueEntryPointGroups[index]; }
 
+    /**
+     * Generate (or load from the shader cache) the code of all kernels for all targets, instead
+     * of generating the code of each kernel when it is first used. Each kernel and target is a
+     * job of the task scheduler. Slang code generation of kernels sharing a Slang global session
+     * is still serialized, but shader cache lookups, decompression, hashing and stores of
+     * different kernels overlap with each other and with code generation. With whole-program
+     * linking, the jobs of the other kernels wait for the first kernel, which generates the code.
+     * @param[in] pScheduler Scheduler to run the jobs on. The code is generated on the calling thread if null.
+     * @return True if the code of all kernels is available.
+     */
+    bool generateAll(TaskScheduler* pScheduler = nullptr) const;
+
     gfx::IShaderProgram* getGfxProgram() const { return mGfxProgram; }
 
 protected:
@@ -220,7 +363,9 @@ class ProgramVersion : public Object
 {
 public:
     /**
-     * Get the program that this version was created from
+     * Get the program that this version was created from.
+     * Versions compiled in the background are created from a copy of the program with the
+     * permutation's defines and type conformances, which the version keeps alive.
      */
     Program* getProgram() const { return mpProgram; }
 
@@ -247,10 +392,50 @@ public:
     }
 
     /**
-     * Get executable kernels based on state in a `ProgramVars`
+     * Get executable kernels specialized with a set of type conformances.
+     * Kernels are memoized per type conformance set, so requesting an existing specialization
+     * again only costs a hash lookup. The most recently used `kMaxCachedKernels` specializations
+     * are retained. This function is thread-safe.
+     * @param[in] typeConformances Global type conformances. The type conformances of each entry point group are added to these.
+     * @param[out] pLog If not null, errors and warnings are appended to the log instead of being printed, and failures don't assert.
+     * @return The kernels. Failures are reported and assert.
      */
-    // TODO @skallweit passing pDevice here is a bit of a WAR
-    // ref<const ProgramKernels> getKernels(Device* pDevice, ProgramVars const* pVars) const;
+    ref<const ProgramKernels> getKernels(const TypeConformanceList& typeConformances, std::string* pLog = nullptr) const;
+
+    /// Maximum number of specializations retained by `getKernels()`.
+    static constexpr size_t kMaxCachedKernels = 16;
+
+    /**
+     * Release memoized kernels, keeping the most recently used specializations.
+     * @param[in] keepCount Number of specializations to keep.
+     * @return Number of specializations released.
+     */
+    size_t trimKernels(size_t keepCount) const;
+
+    /**
+     * Get an estimate of the memory held by this version and its memoized kernels.
+     * Slang doesn't report memory usage. The Slang objects are estimated from the size of the
+     * source files the version was compiled from, kernel code is counted exactly.
+     */
+    size_t getApproximateSize() const;
+
+    /**
+     * Get the key of this version in the shader cache.
+     * This is zero if the shader cache was disabled when the version was created.
+     */
+    const Hash128& getCacheKey() const { return mCacheKey; }
+
+    /**
+     * Check if this version was created from the shader cache without running the Slang front-end.
+     * Such versions have no Slang global scope or entry points, and kernels created from them
+     * only carry kernel code.
+     */
+    bool isCacheBacked() const { return mpSlangGlobalScope == nullptr; }
+
+    /**
+     * Get the source files this version was compiled from (including all imported and included files).
+     */
+    const ShaderFileDependencyList& getFileDependencies() const { return mFileDependencies; }
 
     slang::ISession* getSlangSession() const;
     slang::IComponentType* getSlangGlobalScope() const;
@@ -264,6 +449,7 @@ protected:
     static ref<ProgramVersion> createEmpty(Program* pProgram, slang::IComponentType* pSlangGlobalScope);
 
     ProgramVersion(Program* pProgram, slang::IComponentType* pSlangGlobalScope);
+    ~ProgramVersion();
 
     void init(
         const DefineList& defineList,
@@ -273,12 +459,24 @@ protected:
     );
 
     mutable Program* mpProgram;
+    ref<const Program> mpProgramCopy; ///< Copy of the program a background compile created the version from, mpProgram points to it.
     DefineList mDefines;
     ref<const ProgramReflection> mpReflector;
     std::string mName;
     Slang::ComPtr<slang::IComponentType> mpSlangGlobalScope;
     std::vector<Slang::ComPtr<slang::IComponentType>> mpSlangEntryPoints;
+    Hash128 mCacheKey;
+    ShaderFileDependencyList mFileDependencies;
+    uint32_t mSlangContext = 0; ///< Slang context of the program manager the Slang objects belong to.
 
-    // Cached version of compiled kernels for this program version
-    mutable std::unordered_map<std::string, ref<const ProgramKernels>> mpKernels;
+    // Cached version of compiled kernels for this program version, keyed by type conformance fingerprint.
+    // The list is ordered by last use, most recently used first.
+    struct CachedKernels
+    {
+        Hash128 fingerprint;
+        ref<const ProgramKernels> pKernels;
+    };
+    mutable std::list<CachedKernels> mKernelsLru;
+    mutable std::unordered_map<Hash128, std::list<CachedKernels>::iterator, Hash128::HashFunction> mpKernels;
+    mutable std::mutex mKernelsMutex;
 };
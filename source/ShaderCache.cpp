@@ -0,0 +1,278 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <system_error>
+#include <thread>
+
+#if defined(Linux)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#error "No OS specified"
+#endif
+
+#include "ShaderCache.h"
+
+namespace
+{
+/// Identifies shader cache entry files ('FSCE').
+const uint32_t kEntryMagic = 0x45435346;
+/// Bump when the entry layout changes.
+const uint32_t kEntryVersion = 2;
+/// Interval for polling a lock held by another process.
+const uint32_t kLockPollIntervalMs = 5;
+
+struct EntryHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t payloadSize;
+    Hash128 checksum; ///< Hash of the payload.
+};
+
+uint32_t getProcessId()
+{
+#if defined(Linux)
+    return uint32_t(getpid());
+#elif defined(_WIN32)
+    return uint32_t(GetCurrentProcessId());
+#else
+#error "No OS specified"
+#endif
+}
+
+/**
+ * Get a path for writing an entry, unique across threads and processes sharing the cache.
+ */
+std::filesystem::path getTempPath(const std::filesystem::path& path)
+{
+    static std::atomic<uint32_t> sCounter{0};
+    std::filesystem::path tempPath = path;
+    tempPath += ".tmp." + std::to_string(getProcessId()) + "." + std::to_string(sCounter++);
+    return tempPath;
+}
+
+/**
+ * Open a lock file and try to lock it without blocking.
+ * @param[in,out] handle Open lock file, opened by the first call.
+ * @return True if the lock was acquired.
+ */
+bool tryLockFile(const std::filesystem::path& path, intptr_t& handle)
+{
+#if defined(Linux)
+    if (handle < 0)
+        handle = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    return handle >= 0 && flock(int(handle), LOCK_EX | LOCK_NB) == 0;
+#elif defined(_WIN32)
+    if (handle < 0)
+    {
+        HANDLE file = CreateFileW(
+            path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, nullptr
+        );
+        handle = file == INVALID_HANDLE_VALUE ? -1 : intptr_t(file);
+    }
+    OVERLAPPED overlapped = {};
+    return handle >= 0 && LockFileEx(HANDLE(handle), LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, 1, 0, &overlapped);
+#else
+#error "No OS specified"
+#endif
+}
+
+/**
+ * Close a lock file. This also releases the lock.
+ */
+void closeLockFile(intptr_t handle)
+{
+#if defined(Linux)
+    close(int(handle));
+#elif defined(_WIN32)
+    CloseHandle(HANDLE(handle));
+#else
+#error "No OS specified"
+#endif
+}
+} // namespace
+
+ShaderCache::EntryLock::~EntryLock()
+{
+    release();
+}
+
+ShaderCache::EntryLock::EntryLock(EntryLock&& other) noexcept : mHandle(other.mHandle), mWaited(other.mWaited)
+{
+    other.mHandle = kInvalidHandle;
+}
+
+ShaderCache::EntryLock& ShaderCache::EntryLock::operator=(EntryLock&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        mHandle = other.mHandle;
+        mWaited = other.mWaited;
+        other.mHandle = kInvalidHandle;
+    }
+    return *this;
+}
+
+void ShaderCache::EntryLock::release()
+{
+    if (mHandle != kInvalidHandle)
+        closeLockFile(mHandle);
+    mHandle = kInvalidHandle;
+}
+
+ShaderCache::ShaderCache(std::filesystem::path directory) : mDirectory(std::move(directory))
+{
+    std::error_code ec;
+    std::filesystem::create_directories(mDirectory, ec);
+    if (ec)
+        printf("Warning: Failed to create shader cache directory %s: %s\n", mDirectory.string().c_str(), ec.message().c_str());
+}
+
+std::filesystem::path ShaderCache::getEntryPath(const Hash128& key) const
+{
+    std::string name = key.toString();
+    return mDirectory / name.substr(0, 2) / name;
+}
+
+bool ShaderCache::contains(const Hash128& key) const
+{
+    std::error_code ec;
+    return std::filesystem::is_regular_file(getEntryPath(key), ec);
+}
+
+bool ShaderCache::load(const Hash128& key, std::vector<uint8_t>& data)
+{
+    const std::filesystem::path path = getEntryPath(key);
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::lock_guard<std::mutex> lock(mStatsMutex);
+        mStats.missCount++;
+        return false;
+    }
+
+    EntryHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != kEntryMagic || header.version != kEntryVersion)
+    {
+        std::lock_guard<std::mutex> lock(mStatsMutex);
+        mStats.missCount++;
+        return false;
+    }
+
+    // Don't trust the size in the header of a truncated or corrupt entry before allocating the payload.
+    // The size is taken from the open file, the entry may be replaced by another process meanwhile.
+    file.seekg(0, std::ios::end);
+    const std::streamoff fileSize = file.tellg();
+    file.seekg(sizeof(header), std::ios::beg);
+    const bool sizeValid = file && fileSize >= std::streamoff(sizeof(header)) && header.payloadSize == uint64_t(fileSize) - sizeof(header);
+    if (sizeValid)
+        data.resize(header.payloadSize);
+    if (!sizeValid || !file.read(reinterpret_cast<char*>(data.data()), header.payloadSize) || hash128(data.data(), data.size()) != header.checksum)
+    {
+        printf("Warning: Ignoring corrupt shader cache entry %s\n", path.string().c_str());
+        data.clear();
+        std::lock_guard<std::mutex> lock(mStatsMutex);
+        mStats.missCount++;
+        mStats.corruptCount++;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    mStats.hitCount++;
+    mStats.bytesRead += header.payloadSize;
+    return true;
+}
+
+bool ShaderCache::store(const Hash128& key, const void* data, size_t size)
+{
+    std::filesystem::path path = getEntryPath(key);
+    std::filesystem::path tempPath = getTempPath(path);
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            printf("Warning: Failed to write shader cache entry %s\n", path.string().c_str());
+            return false;
+        }
+
+        EntryHeader header = {kEntryMagic, kEntryVersion, uint64_t(size), hash128(data, size)};
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(static_cast<const char*>(data), size);
+        file.close();
+        if (!file)
+        {
+            printf("Warning: Failed to write shader cache entry %s\n", path.string().c_str());
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+    }
+
+    // Readers in other processes see either the previous entry or the complete new one.
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec)
+    {
+        printf("Warning: Failed to write shader cache entry %s: %s\n", path.string().c_str(), ec.message().c_str());
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    mStats.storeCount++;
+    mStats.bytesWritten += size;
+    return true;
+}
+
+ShaderCache::Stats ShaderCache::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    return mStats;
+}
+
+void ShaderCache::resetStats()
+{
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    mStats = {};
+}
+
+ShaderCache::EntryLock ShaderCache::lockEntry(const Hash128& key) const
+{
+    std::filesystem::path path = getEntryPath(key);
+    std::filesystem::path lockPath = path;
+    lockPath += ".lock";
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    EntryLock lock;
+    auto start = std::chrono::steady_clock::now();
+    while (!tryLockFile(lockPath, lock.mHandle))
+    {
+        if (lock.mHandle == EntryLock::kInvalidHandle)
+        {
+            printf("Warning: Failed to open shader cache lock file %s\n", lockPath.string().c_str());
+            return EntryLock();
+        }
+        if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(kLockTimeoutMs))
+        {
+            printf("Warning: Timed out waiting for shader cache lock %s\n", lockPath.string().c_str());
+            return EntryLock();
+        }
+        lock.mWaited = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(kLockPollIntervalMs));
+    }
+    return lock;
+}
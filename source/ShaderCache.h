@@ -0,0 +1,115 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+#include "Hash.h"
+
+/**
+ * Persistent content-addressed cache for compiled shader code.
+ *
+ * Each entry is stored in its own file, named after the 128-bit key of the entry.
+ * Entries are spread over 256 sub-directories (first two hex digits of the key) to keep
+ * directory sizes reasonable. The cache never interprets the payload, it is up to the
+ * caller to build keys that cover all inputs of the cached data.
+ *
+ * The cache directory can be shared by several processes. Entries are written to a
+ * temporary file and renamed into place, so readers never see partially written entries.
+ * Each entry carries a checksum of its payload, which is validated on load. Entries that
+ * are expensive to produce can be locked with `lockEntry()`, so that a process that needs
+ * an entry another process is producing waits for it instead of producing it again.
+ */
+class ShaderCache
+{
+public:
+    struct Stats
+    {
+        size_t hitCount = 0;       ///< Number of successful loads.
+        size_t missCount = 0;      ///< Number of loads that did not find a valid entry.
+        size_t storeCount = 0;     ///< Number of entries written.
+        uint64_t bytesRead = 0;    ///< Payload bytes read from disk.
+        uint64_t bytesWritten = 0; ///< Payload bytes written to disk.
+        size_t corruptCount = 0;   ///< Number of loads that found an entry with an invalid checksum.
+    };
+
+    /**
+     * Advisory lock on a cache entry, held across processes until it is destroyed.
+     * The lock is released by the operating system if the process holding it terminates.
+     */
+    class EntryLock
+    {
+    public:
+        EntryLock() = default;
+        ~EntryLock();
+        EntryLock(EntryLock&& other) noexcept;
+        EntryLock& operator=(EntryLock&& other) noexcept;
+        EntryLock(const EntryLock&) = delete;
+        EntryLock& operator=(const EntryLock&) = delete;
+
+        bool isLocked() const { return mHandle != kInvalidHandle; }
+
+        /// True if the lock was held by someone else when it was requested.
+        bool hasWaited() const { return mWaited; }
+
+    private:
+        friend class ShaderCache;
+        static constexpr intptr_t kInvalidHandle = -1;
+        void release();
+
+        intptr_t mHandle = kInvalidHandle; ///< File descriptor (Linux) or file handle (Windows) of the lock file.
+        bool mWaited = false;
+    };
+
+    /**
+     * Create a shader cache in the given directory. The directory is created if it doesn't exist.
+     */
+    explicit ShaderCache(std::filesystem::path directory);
+
+    const std::filesystem::path& getDirectory() const { return mDirectory; }
+
+    /**
+     * Check if an entry exists. This does not validate the entry and does not affect the statistics.
+     */
+    bool contains(const Hash128& key) const;
+
+    /**
+     * Load an entry.
+     * @param[in] key Entry key.
+     * @param[out] data Payload of the entry.
+     * @return True if a valid entry was found.
+     */
+    bool load(const Hash128& key, std::vector<uint8_t>& data);
+
+    /**
+     * Store an entry. Existing entries with the same key are replaced.
+     * @return True if the entry was written successfully.
+     */
+    bool store(const Hash128& key, const void* data, size_t size);
+
+    /**
+     * Lock an entry, waiting while another thread or process holds the lock.
+     * Gives up after `kLockTimeoutMs`, in which case the returned lock is not locked and the
+     * caller should proceed without it.
+     */
+    EntryLock lockEntry(const Hash128& key) const;
+
+    /// Maximum time to wait for an entry lock.
+    static constexpr uint32_t kLockTimeoutMs = 60000;
+
+    /**
+     * Get the statistics. Loads and stores can run on several threads, the statistics are guarded by a lock of their own.
+     */
+    Stats getStats() const;
+    void resetStats();
+
+private:
+    std::filesystem::path getEntryPath(const Hash128& key) const;
+
+    std::filesystem::path mDirectory;
+    mutable std::mutex mStatsMutex;
+    Stats mStats;
+};
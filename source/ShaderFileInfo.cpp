@@ -0,0 +1,223 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#include "ShaderFileInfo.h"
+
+namespace
+{
+bool isIdentifierStart(char c)
+{
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool isIdentifierChar(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool getFileState(const std::filesystem::path& path, int64_t& modifiedTime, uint64_t& size)
+{
+    std::error_code ec;
+    modifiedTime = int64_t(std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+    if (ec)
+        return false;
+    size = uint64_t(std::filesystem::file_size(path, ec));
+    return !ec;
+}
+
+bool readFile(const std::filesystem::path& path, std::string& text)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+template<typename T>
+void writeValue(std::vector<uint8_t>& data, const T& value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(value));
+}
+
+template<typename T>
+bool readValue(const std::vector<uint8_t>& data, size_t& offset, T& value)
+{
+    if (data.size() - offset < sizeof(value))
+        return false;
+    std::memcpy(&value, data.data() + offset, sizeof(value));
+    offset += sizeof(value);
+    return true;
+}
+
+/**
+ * Collect identifier tokens of a source file, skipping comments, string and number literals.
+ */
+void scanIdentifiers(const std::string& text, ShaderFileInfo& info)
+{
+    size_t i = 0;
+    const size_t n = text.size();
+    while (i < n)
+    {
+        char c = text[i];
+        if (c == '/' && i + 1 < n && text[i + 1] == '/')
+        {
+            while (i < n && text[i] != '\n')
+                i++;
+        }
+        else if (c == '/' && i + 1 < n && text[i + 1] == '*')
+        {
+            size_t end = text.find("*/", i + 2);
+            i = end == std::string::npos ? n : end + 2;
+        }
+        else if (c == '"' || c == '\'')
+        {
+            i++;
+            while (i < n && text[i] != c && text[i] != '\n')
+                i += text[i] == '\\' ? 2 : 1;
+            i++;
+        }
+        else if (c == '#' && i + 1 < n && text[i + 1] == '#')
+        {
+            info.hasTokenPasting = true;
+            i += 2;
+        }
+        else if (std::isdigit(static_cast<unsigned char>(c)))
+        {
+            // Skip the whole number including suffixes (e.g. 1.0f, 0xffu).
+            while (i < n && (isIdentifierChar(text[i]) || text[i] == '.'))
+                i++;
+        }
+        else if (isIdentifierStart(c))
+        {
+            size_t start = i;
+            while (i < n && isIdentifierChar(text[i]))
+                i++;
+            info.identifiers.emplace(text, start, i - start);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+} // namespace
+
+bool getShaderFileDependency(const std::string& path, ShaderFileDependency& dependency)
+{
+    std::string text;
+    if (!getFileState(path, dependency.modifiedTime, dependency.size) || !readFile(path, text))
+        return false;
+    dependency.path = path;
+    dependency.contentHash = hash128(text.data(), text.size());
+    return true;
+}
+
+bool isShaderFileDependencyUpToDate(ShaderFileDependency& dependency)
+{
+    int64_t modifiedTime;
+    uint64_t size;
+    if (!getFileState(dependency.path, modifiedTime, size) || size != dependency.size)
+        return false;
+    if (modifiedTime == dependency.modifiedTime)
+        return true;
+
+    std::string text;
+    if (!readFile(dependency.path, text) || hash128(text.data(), text.size()) != dependency.contentHash)
+        return false;
+    dependency.modifiedTime = modifiedTime;
+    return true;
+}
+
+void serializeShaderFileDependencies(const ShaderFileDependencyList& dependencies, std::vector<uint8_t>& data)
+{
+    writeValue(data, uint32_t(dependencies.size()));
+    for (const auto& dependency : dependencies)
+    {
+        writeValue(data, uint32_t(dependency.path.size()));
+        data.insert(data.end(), dependency.path.begin(), dependency.path.end());
+        writeValue(data, dependency.modifiedTime);
+        writeValue(data, dependency.size);
+        writeValue(data, dependency.contentHash);
+    }
+}
+
+bool deserializeShaderFileDependencies(const std::vector<uint8_t>& data, ShaderFileDependencyList& dependencies)
+{
+    size_t offset = 0;
+    uint32_t count;
+    if (!readValue(data, offset, count))
+        return false;
+    dependencies.resize(count);
+    for (auto& dependency : dependencies)
+    {
+        uint32_t pathSize;
+        if (!readValue(data, offset, pathSize) || data.size() - offset < pathSize)
+            return false;
+        dependency.path.assign(reinterpret_cast<const char*>(data.data() + offset), pathSize);
+        offset += pathSize;
+        if (!readValue(data, offset, dependency.modifiedTime) || !readValue(data, offset, dependency.size) ||
+            !readValue(data, offset, dependency.contentHash))
+            return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const ShaderFileInfo> ShaderFileInfoCache::get(const std::filesystem::path& path)
+{
+    int64_t modifiedTime;
+    uint64_t size;
+    if (!getFileState(path, modifiedTime, size))
+        return nullptr;
+
+    std::string key = path.string();
+    auto it = mFiles.find(key);
+    if (it != mFiles.end() && it->second->modifiedTime == modifiedTime && it->second->size == size)
+        return it->second;
+
+    std::string text;
+    if (!readFile(path, text))
+        return nullptr;
+
+    auto pInfo = std::make_shared<ShaderFileInfo>();
+    pInfo->modifiedTime = modifiedTime;
+    pInfo->size = size;
+    pInfo->contentHash = hash128(text.data(), text.size());
+    scanIdentifiers(text, *pInfo);
+
+    mFiles[key] = pInfo;
+    return pInfo;
+}
+
+bool ShaderFileInfoCache::getReferencedDefines(const std::vector<std::string>& paths, const DefineList& defines, DefineList& referencedDefines)
+{
+    std::vector<std::shared_ptr<const ShaderFileInfo>> infos;
+    infos.reserve(paths.size());
+    for (const auto& path : paths)
+    {
+        auto pInfo = get(path);
+        if (!pInfo)
+            return false;
+        infos.push_back(std::move(pInfo));
+    }
+
+    for (const auto& define : defines)
+    {
+        for (const auto& pInfo : infos)
+        {
+            if (pInfo->mayReferenceMacro(define.first))
+            {
+                referencedDefines.add(define.first, define.second);
+                break;
+            }
+        }
+    }
+    return true;
+}
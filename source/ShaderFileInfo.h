@@ -0,0 +1,96 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#pragma once
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "DefineList.h"
+#include "Hash.h"
+
+/**
+ * Information about a shader source file used for building cache keys.
+ */
+struct ShaderFileInfo
+{
+    int64_t modifiedTime = 0; ///< Last write time (file clock ticks).
+    uint64_t size = 0;        ///< File size in bytes.
+    Hash128 contentHash;      ///< Hash of the file contents.
+
+    /// All identifier tokens in the file, excluding comments and string literals.
+    /// A macro can only affect the preprocessed file if its name is in this set.
+    std::unordered_set<std::string> identifiers;
+
+    /// True if the file uses token pasting (`##`), in which case any macro may be referenced.
+    bool hasTokenPasting = false;
+
+    /**
+     * Check if a macro can affect the preprocessing of this file.
+     */
+    bool mayReferenceMacro(const std::string& name) const { return hasTokenPasting || identifiers.count(name) != 0; }
+};
+
+/**
+ * A source file a compile depended on, with its state at the time it was read.
+ */
+struct ShaderFileDependency
+{
+    std::string path;         ///< Path as reported by Slang.
+    int64_t modifiedTime = 0; ///< Last write time (file clock ticks).
+    uint64_t size = 0;        ///< File size in bytes.
+    Hash128 contentHash;      ///< Hash of the file contents.
+};
+
+using ShaderFileDependencyList = std::vector<ShaderFileDependency>;
+
+/**
+ * Get the current state of a file.
+ * @return False if the file could not be read.
+ */
+bool getShaderFileDependency(const std::string& path, ShaderFileDependency& dependency);
+
+/**
+ * Check if a file still has the contents recorded in a dependency.
+ * The contents are only hashed again if the size or modification time changed. If only the
+ * modification time changed, the recorded time is updated so the next check is cheap again.
+ */
+bool isShaderFileDependencyUpToDate(ShaderFileDependency& dependency);
+
+/**
+ * Serialize a list of dependencies (used for dependency manifests in the shader cache).
+ */
+void serializeShaderFileDependencies(const ShaderFileDependencyList& dependencies, std::vector<uint8_t>& data);
+bool deserializeShaderFileDependencies(const std::vector<uint8_t>& data, ShaderFileDependencyList& dependencies);
+
+/**
+ * Cache of `ShaderFileInfo` objects.
+ * Files are only re-read if their size or modification time changed.
+ */
+class ShaderFileInfoCache
+{
+public:
+    /**
+     * Get information about a file.
+     * @param[in] path Path to the file.
+     * @return The file info, or nullptr if the file could not be read.
+     */
+    std::shared_ptr<const ShaderFileInfo> get(const std::filesystem::path& path);
+
+    /**
+     * Collect the subset of macro definitions that can affect the preprocessing of any of the given files.
+     * @param[in] paths Source files.
+     * @param[in] defines All macro definitions in effect.
+     * @param[out] referencedDefines Macro definitions that may be referenced by the files.
+     * @return False if any of the files could not be read.
+     */
+    bool getReferencedDefines(const std::vector<std::string>& paths, const DefineList& defines, DefineList& referencedDefines);
+
+    void clear() { mFiles.clear(); }
+
+private:
+    std::unordered_map<std::string, std::shared_ptr<const ShaderFileInfo>> mFiles;
+};
@@ -0,0 +1,244 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <slang-com-ptr.h>
+
+#include "SlangModuleCache.h"
+
+namespace
+{
+/// Bump when the way module keys are computed or the index layout changes.
+const uint32_t kModuleCacheVersion = 1;
+/// Distinguishes index entries from module entries ('INDX').
+const uint32_t kIndexTag = 0x58444e49;
+
+void writeU32(std::vector<uint8_t>& data, uint32_t value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(value));
+}
+
+void writeString(std::vector<uint8_t>& data, const std::string& str)
+{
+    writeU32(data, uint32_t(str.size()));
+    data.insert(data.end(), str.begin(), str.end());
+}
+
+bool readU32(const std::vector<uint8_t>& data, size_t& offset, uint32_t& value)
+{
+    if (data.size() - offset < sizeof(value))
+        return false;
+    std::memcpy(&value, data.data() + offset, sizeof(value));
+    offset += sizeof(value);
+    return true;
+}
+
+bool readString(const std::vector<uint8_t>& data, size_t& offset, std::string& str)
+{
+    uint32_t size;
+    if (!readU32(data, offset, size) || data.size() - offset < size)
+        return false;
+    str.assign(reinterpret_cast<const char*>(data.data() + offset), size);
+    offset += size;
+    return true;
+}
+
+Hash128 computeIndexKey(const Hash128& sessionKey, const Hash128& programKey)
+{
+    Hasher hasher;
+    hasher.update(kModuleCacheVersion);
+    hasher.update(kIndexTag);
+    hasher.update(sessionKey);
+    hasher.update(programKey);
+    return hasher.getDigest();
+}
+
+bool isModuleLoaded(slang::ISession* pSession, const std::string& name)
+{
+    for (SlangInt i = 0; i < pSession->getLoadedModuleCount(); ++i)
+    {
+        const char* loadedName = pSession->getLoadedModule(i)->getName();
+        if (loadedName && name == loadedName)
+            return true;
+    }
+    return false;
+}
+} // namespace
+
+SlangModuleCache::SlangModuleCache(std::filesystem::path directory) : mCache(std::move(directory)) {}
+
+bool SlangModuleCache::computeModuleKey(const Hash128& sessionKey, const ModuleRecord& record, const DefineList& defines, Hash128& key)
+{
+    Hasher hasher;
+    hasher.update(kModuleCacheVersion);
+    hasher.update(sessionKey);
+    hasher.update(record.name);
+    hasher.update(record.path);
+
+    hasher.update(uint64_t(record.dependencies.size()));
+    for (const auto& path : record.dependencies)
+    {
+        auto pInfo = mFileInfoCache.get(path);
+        if (!pInfo)
+            return false;
+        hasher.update(path);
+        hasher.update(pInfo->contentHash);
+    }
+
+    DefineList referencedDefines;
+    if (!mFileInfoCache.getReferencedDefines(record.dependencies, defines, referencedDefines))
+        return false;
+    hasher.update(uint64_t(referencedDefines.size()));
+    for (const auto& define : referencedDefines)
+    {
+        hasher.update(define.first);
+        hasher.update(define.second);
+    }
+
+    key = hasher.getDigest();
+    return true;
+}
+
+bool SlangModuleCache::loadIndex(const Hash128& indexKey, std::vector<ModuleRecord>& records)
+{
+    std::vector<uint8_t> data;
+    if (!mCache.load(indexKey, data))
+        return false;
+
+    size_t offset = 0;
+    uint32_t count;
+    if (!readU32(data, offset, count))
+        return false;
+    records.resize(count);
+    for (auto& record : records)
+    {
+        uint32_t dependencyCount;
+        if (!readString(data, offset, record.name) || !readString(data, offset, record.path) || !readU32(data, offset, dependencyCount))
+            return false;
+        record.dependencies.resize(dependencyCount);
+        for (auto& dependency : record.dependencies)
+        {
+            if (!readString(data, offset, dependency))
+                return false;
+        }
+    }
+    return true;
+}
+
+void SlangModuleCache::storeIndex(const Hash128& indexKey, const std::vector<ModuleRecord>& records)
+{
+    std::vector<uint8_t> data;
+    writeU32(data, uint32_t(records.size()));
+    for (const auto& record : records)
+    {
+        writeString(data, record.name);
+        writeString(data, record.path);
+        writeU32(data, uint32_t(record.dependencies.size()));
+        for (const auto& dependency : record.dependencies)
+            writeString(data, dependency);
+    }
+
+    // Only rewrite the index if it changed.
+    std::vector<uint8_t> existing;
+    if (mCache.load(indexKey, existing) && existing == data)
+        return;
+    mCache.store(indexKey, data.data(), data.size());
+}
+
+size_t SlangModuleCache::loadModules(slang::ISession* pSession, const Hash128& sessionKey, const Hash128& programKey, const DefineList& defines)
+{
+    std::vector<ModuleRecord> records;
+    if (!loadIndex(computeIndexKey(sessionKey, programKey), records))
+        return 0;
+
+    // The dependencies of a module include the files of all modules it imports, so loading
+    // modules with fewer dependencies first makes sure imports are available when needed.
+    std::stable_sort(
+        records.begin(),
+        records.end(),
+        [](const ModuleRecord& a, const ModuleRecord& b) { return a.dependencies.size() < b.dependencies.size(); }
+    );
+
+    size_t loadedCount = 0;
+    std::vector<uint8_t> data;
+    for (const auto& record : records)
+    {
+        // The module may already have been loaded from source as an import of a previous module.
+        if (isModuleLoaded(pSession, record.name))
+            continue;
+
+        Hash128 key;
+        if (!computeModuleKey(sessionKey, record, defines, key) || !mCache.load(key, data))
+        {
+            mStats.modulesStale++;
+            continue;
+        }
+
+        Slang::ComPtr<ISlangBlob> pBlob;
+        pBlob.attach(slang_createBlob(data.data(), data.size()));
+        Slang::ComPtr<slang::IBlob> pDiagnostics;
+        slang::IModule* pModule = pSession->loadModuleFromIRBlob(record.name.c_str(), record.path.c_str(), pBlob, pDiagnostics.writeRef());
+        if (!pModule)
+        {
+            printf("Warning: Failed to load cached Slang module %s\n", record.name.c_str());
+            if (pDiagnostics && pDiagnostics->getBufferSize() > 0)
+                printf("%s\n", (const char*)pDiagnostics->getBufferPointer());
+            mStats.modulesStale++;
+            continue;
+        }
+
+        mStats.modulesLoaded++;
+        loadedCount++;
+    }
+    return loadedCount;
+}
+
+void SlangModuleCache::storeModules(
+    slang::ISession* pSession,
+    const Hash128& sessionKey,
+    const Hash128& programKey,
+    const DefineList& defines,
+    const std::set<std::string>& translationUnitPaths
+)
+{
+    std::vector<ModuleRecord> records;
+    for (SlangInt i = 0; i < pSession->getLoadedModuleCount(); ++i)
+    {
+        slang::IModule* pModule = pSession->getLoadedModule(i);
+        const char* name = pModule->getName();
+        const char* path = pModule->getFilePath();
+
+        // Skip modules created from strings and the program's own translation units.
+        if (!name || !path || path[0] == '\0' || translationUnitPaths.count(path) != 0)
+            continue;
+
+        ModuleRecord record;
+        record.name = name;
+        record.path = path;
+        for (SlangInt32 j = 0; j < pModule->getDependencyFileCount(); ++j)
+            record.dependencies.push_back(pModule->getDependencyFilePath(j));
+
+        Hash128 key;
+        if (!computeModuleKey(sessionKey, record, defines, key))
+            continue;
+
+        if (!mCache.contains(key))
+        {
+            Slang::ComPtr<ISlangBlob> pBlob;
+            if (SLANG_FAILED(pModule->serialize(pBlob.writeRef())) || !pBlob)
+            {
+                printf("Warning: Failed to serialize Slang module %s\n", name);
+                continue;
+            }
+            if (mCache.store(key, pBlob->getBufferPointer(), pBlob->getBufferSize()))
+                mStats.modulesStored++;
+        }
+
+        records.push_back(std::move(record));
+    }
+
+    storeIndex(computeIndexKey(sessionKey, programKey), records);
+}
@@ -0,0 +1,95 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#pragma once
+#include <filesystem>
+#include <set>
+#include <string>
+#include <vector>
+#include <slang.h>
+
+#include "DefineList.h"
+#include "Hash.h"
+#include "ShaderCache.h"
+#include "ShaderFileInfo.h"
+
+/**
+ * Persistent cache of checked Slang modules.
+ *
+ * Imported modules (e.g. `Scene.Scene` or the material modules) are serialized as Slang IR
+ * blobs after a successful front-end compile. Before the next compile of a program, the
+ * modules it imported last time are loaded from their IR blobs into the new session, so that
+ * Slang resolves the imports without parsing and checking the sources again.
+ *
+ * The key of a module covers the contents of all files the module depends on (including the
+ * files of modules it imports), the values of the macros that are referenced in any of these
+ * files, and the session configuration. Macros that don't appear in a module's sources can't
+ * change it, so permutations of a program that only differ in such macros share the cached
+ * module.
+ *
+ * For each program (identified by its translation units and the session configuration), an
+ * index entry lists the modules that were loaded by its last compile. The index is only a hint,
+ * every module key is validated against the current file contents and macros when loading.
+ */
+class SlangModuleCache
+{
+public:
+    struct Stats
+    {
+        size_t modulesLoaded = 0; ///< Modules loaded from IR blobs.
+        size_t modulesStale = 0;  ///< Indexed modules that had to be compiled from source.
+        size_t modulesStored = 0; ///< Modules serialized into the cache.
+    };
+
+    /**
+     * Create a module cache in the given directory. The directory is created if it doesn't exist.
+     */
+    explicit SlangModuleCache(std::filesystem::path directory);
+
+    const std::filesystem::path& getDirectory() const { return mCache.getDirectory(); }
+
+    /**
+     * Load the cached modules of a program into a session.
+     * @param[in] pSession Session the program will be compiled in.
+     * @param[in] sessionKey Key of the session configuration (compiler version, target, flags, search paths).
+     * @param[in] programKey Key identifying the program's translation units.
+     * @param[in] defines All macro definitions of the session.
+     * @return Number of modules loaded.
+     */
+    size_t loadModules(slang::ISession* pSession, const Hash128& sessionKey, const Hash128& programKey, const DefineList& defines);
+
+    /**
+     * Serialize the modules loaded by a compile into the cache and update the program's index entry.
+     * @param[in] pSession Session the program was compiled in.
+     * @param[in] sessionKey Key of the session configuration.
+     * @param[in] programKey Key identifying the program's translation units.
+     * @param[in] defines All macro definitions of the session.
+     * @param[in] translationUnitPaths Source files of the program's translation units. Modules from these files are not cached.
+     */
+    void storeModules(
+        slang::ISession* pSession,
+        const Hash128& sessionKey,
+        const Hash128& programKey,
+        const DefineList& defines,
+        const std::set<std::string>& translationUnitPaths
+    );
+
+    const Stats& getStats() const { return mStats; }
+    void resetStats() { mStats = {}; }
+
+private:
+    struct ModuleRecord
+    {
+        std::string name;
+        std::string path;
+        std::vector<std::string> dependencies;
+    };
+
+    bool computeModuleKey(const Hash128& sessionKey, const ModuleRecord& record, const DefineList& defines, Hash128& key);
+    bool loadIndex(const Hash128& indexKey, std::vector<ModuleRecord>& records);
+    void storeIndex(const Hash128& indexKey, const std::vector<ModuleRecord>& records);
+
+    ShaderCache mCache;
+    ShaderFileInfoCache mFileInfoCache;
+    Stats mStats;
+};
@@ -0,0 +1,413 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "SpirvCompression.h"
+
+namespace
+{
+const uint32_t kSpirvMagic = 0x07230203;
+const size_t kSpirvHeaderWords = 5;
+
+/// Identifies compressed modules ('FSPV').
+const uint32_t kCompressedMagic = 0x56505346;
+/// Bump when the encoding changes.
+const uint32_t kCompressedVersion = 1;
+
+struct CompressedHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t wordCount; ///< Word count of the uncompressed module.
+    uint32_t spirvHeader[kSpirvHeaderWords];
+};
+
+/// Word counts up to this are stored in the instruction tag, larger ones in an extra varint.
+const uint32_t kInlineWordCountLimit = 15;
+
+const uint8_t kAllIds = 0xff;
+
+/**
+ * Operand layout of an opcode. Operands are: result type, result ID, `idCount` IDs and literals.
+ */
+struct OpcodeLayout
+{
+    bool hasType = false;
+    bool hasResult = false;
+    uint8_t idCount = 0;
+    bool stringLiterals = false; ///< Literals are stored verbatim (strings).
+};
+
+OpcodeLayout makeLayout(bool hasType, bool hasResult, uint8_t idCount, bool stringLiterals = false)
+{
+    OpcodeLayout layout;
+    layout.hasType = hasType;
+    layout.hasResult = hasResult;
+    layout.idCount = idCount;
+    layout.stringLiterals = stringLiterals;
+    return layout;
+}
+
+/**
+ * Compute the operand layout of the opcodes that are common in shaders. Other opcodes have an
+ * empty layout and all their operands are stored as plain literals.
+ */
+OpcodeLayout computeOpcodeLayout(uint32_t opcode)
+{
+    switch (opcode)
+    {
+    case 3:  // OpSource
+    case 4:  // OpSourceExtension
+    case 10: // OpExtension
+    case 15: // OpEntryPoint
+        return makeLayout(false, false, 0, true);
+    case 5: // OpName
+    case 6: // OpMemberName
+        return makeLayout(false, false, 1, true);
+    case 7:  // OpString
+    case 11: // OpExtInstImport
+        return makeLayout(false, true, 0, true);
+    case 12: // OpExtInst
+        return makeLayout(true, true, 1);
+    case 16: // OpExecutionMode
+    case 71: // OpDecorate
+    case 72: // OpMemberDecorate
+        return makeLayout(false, false, 1);
+    case 19: // OpTypeVoid
+    case 20: // OpTypeBool
+    case 21: // OpTypeInt
+    case 22: // OpTypeFloat
+    case 26: // OpTypeSampler
+    case 248: // OpLabel
+        return makeLayout(false, true, 0);
+    case 23: // OpTypeVector
+    case 24: // OpTypeMatrix
+    case 25: // OpTypeImage
+    case 27: // OpTypeSampledImage
+    case 29: // OpTypeRuntimeArray
+        return makeLayout(false, true, 1);
+    case 28: // OpTypeArray
+    case 30: // OpTypeStruct
+    case 33: // OpTypeFunction
+        return makeLayout(false, true, kAllIds);
+    case 41: // OpConstantTrue
+    case 42: // OpConstantFalse
+    case 43: // OpConstant
+    case 54: // OpFunction
+    case 55: // OpFunctionParameter
+    case 59: // OpVariable
+        return makeLayout(true, true, 0);
+    case 44: // OpConstantComposite
+    case 57: // OpFunctionCall
+    case 65: // OpAccessChain
+    case 66: // OpInBoundsAccessChain
+    case 67: // OpPtrAccessChain
+    case 77: // OpVectorExtractDynamic
+    case 78: // OpVectorInsertDynamic
+    case 80: // OpCompositeConstruct
+    case 86: // OpSampledImage
+    case 169: // OpSelect
+    case 201: // OpBitFieldInsert
+    case 202: // OpBitFieldSExtract
+    case 203: // OpBitFieldUExtract
+    case 245: // OpPhi
+        return makeLayout(true, true, kAllIds);
+    case 62: // OpStore
+    case 63: // OpCopyMemory
+    case 246: // OpLoopMerge
+        return makeLayout(false, false, 2);
+    case 99:  // OpImageWrite
+    case 224: // OpControlBarrier
+    case 250: // OpBranchConditional
+        return makeLayout(false, false, 3);
+    case 225: // OpMemoryBarrier
+    case 251: // OpSwitch
+        return makeLayout(false, false, 2);
+    case 247: // OpSelectionMerge
+    case 249: // OpBranch
+    case 254: // OpReturnValue
+        return makeLayout(false, false, 1);
+    case 61:  // OpLoad
+    case 81:  // OpCompositeExtract
+    case 83:  // OpCopyObject
+    case 84:  // OpTranspose
+    case 100: // OpImage
+    case 126: // OpSNegate
+    case 127: // OpFNegate
+    case 154: // OpAny
+    case 155: // OpAll
+    case 156: // OpIsNan
+    case 157: // OpIsInf
+    case 168: // OpLogicalNot
+    case 200: // OpNot
+    case 205: // OpBitCount
+        return makeLayout(true, true, 1);
+    case 79: // OpVectorShuffle
+    case 82: // OpCompositeInsert
+        return makeLayout(true, true, 2);
+    default:
+        break;
+    }
+
+    if (opcode >= 87 && opcode <= 98) // Image sampling, fetch, gather and read
+        return makeLayout(true, true, 2);
+    if (opcode >= 109 && opcode <= 124) // Conversions and OpBitcast
+        return makeLayout(true, true, 1);
+    if (opcode >= 128 && opcode <= 153) // Arithmetic
+        return makeLayout(true, true, 2);
+    if ((opcode >= 164 && opcode <= 167) || (opcode >= 170 && opcode <= 199)) // Logical, comparison, shifts and bitwise
+        return makeLayout(true, true, 2);
+    if (opcode >= 207 && opcode <= 215) // Derivatives
+        return makeLayout(true, true, 1);
+    return OpcodeLayout();
+}
+
+/// Opcodes with a known layout are below this.
+const uint32_t kOpcodeTableSize = 256;
+
+const OpcodeLayout& getOpcodeLayout(uint32_t opcode)
+{
+    static const std::array<OpcodeLayout, kOpcodeTableSize> kLayouts = []()
+    {
+        std::array<OpcodeLayout, kOpcodeTableSize> layouts;
+        for (uint32_t i = 0; i < kOpcodeTableSize; ++i)
+            layouts[i] = computeOpcodeLayout(i);
+        return layouts;
+    }();
+    static const OpcodeLayout kUnknownLayout;
+    return opcode < kOpcodeTableSize ? kLayouts[opcode] : kUnknownLayout;
+}
+
+/**
+ * Split the operands of an instruction into the groups of its layout.
+ */
+void getOperandCounts(const OpcodeLayout& layout, uint32_t operandCount, uint32_t& typeCount, uint32_t& resultCount, uint32_t& idCount)
+{
+    typeCount = std::min(operandCount, uint32_t(layout.hasType));
+    operandCount -= typeCount;
+    resultCount = std::min(operandCount, uint32_t(layout.hasResult));
+    operandCount -= resultCount;
+    idCount = std::min(operandCount, uint32_t(layout.idCount));
+}
+
+uint32_t zigzagEncode(uint32_t delta)
+{
+    return (delta << 1) ^ uint32_t(int32_t(delta) >> 31);
+}
+
+uint32_t zigzagDecode(uint32_t value)
+{
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+void writeVarint(std::vector<uint8_t>& data, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        data.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    data.push_back(uint8_t(value));
+}
+
+void writeWord(std::vector<uint8_t>& data, uint32_t value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(value));
+}
+
+bool readVarint(const uint8_t*& pData, const uint8_t* pEnd, uint32_t& value)
+{
+    // Most operands fit in a single byte.
+    if (pData != pEnd && *pData < 0x80)
+    {
+        value = *pData++;
+        return true;
+    }
+
+    value = 0;
+    for (uint32_t shift = 0; shift < 35; shift += 7)
+    {
+        if (pData == pEnd)
+            return false;
+        uint8_t byte = *pData++;
+        value |= uint32_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool readWord(const uint8_t*& pData, const uint8_t* pEnd, uint32_t& value)
+{
+    if (size_t(pEnd - pData) < sizeof(value))
+        return false;
+    std::memcpy(&value, pData, sizeof(value));
+    pData += sizeof(value);
+    return true;
+}
+} // namespace
+
+bool isSpirv(const void* data, size_t size)
+{
+    if (size < kSpirvHeaderWords * sizeof(uint32_t) || size % sizeof(uint32_t) != 0)
+        return false;
+    uint32_t magic;
+    std::memcpy(&magic, data, sizeof(magic));
+    return magic == kSpirvMagic;
+}
+
+bool isCompressedSpirv(const void* data, size_t size)
+{
+    if (size < sizeof(CompressedHeader))
+        return false;
+    CompressedHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    return header.magic == kCompressedMagic && header.version == kCompressedVersion;
+}
+
+bool compressSpirv(const void* data, size_t size, std::vector<uint8_t>& compressed)
+{
+    if (!isSpirv(data, size))
+        return false;
+
+    const size_t wordCount = size / sizeof(uint32_t);
+    std::vector<uint32_t> words(wordCount);
+    std::memcpy(words.data(), data, size);
+
+    CompressedHeader header;
+    header.magic = kCompressedMagic;
+    header.version = kCompressedVersion;
+    header.wordCount = uint32_t(wordCount);
+    std::memcpy(header.spirvHeader, words.data(), sizeof(header.spirvHeader));
+
+    compressed.clear();
+    compressed.reserve(size / 2);
+    compressed.resize(sizeof(header));
+    std::memcpy(compressed.data(), &header, sizeof(header));
+
+    uint32_t lastResult = 0;
+    size_t offset = kSpirvHeaderWords;
+    while (offset < wordCount)
+    {
+        const uint32_t opcode = words[offset] & 0xffff;
+        const uint32_t instructionWordCount = words[offset] >> 16;
+        if (instructionWordCount == 0 || instructionWordCount > wordCount - offset)
+            return false;
+
+        writeVarint(compressed, (opcode << 4) | std::min(instructionWordCount, kInlineWordCountLimit));
+        if (instructionWordCount >= kInlineWordCountLimit)
+            writeVarint(compressed, instructionWordCount - kInlineWordCountLimit);
+
+        const OpcodeLayout& layout = getOpcodeLayout(opcode);
+        uint32_t typeCount, resultCount, idCount;
+        getOperandCounts(layout, instructionWordCount - 1, typeCount, resultCount, idCount);
+
+        const uint32_t* pOperand = words.data() + offset + 1;
+        const uint32_t* pEnd = words.data() + offset + instructionWordCount;
+        if (typeCount)
+            writeVarint(compressed, *pOperand++);
+        if (resultCount)
+        {
+            writeVarint(compressed, zigzagEncode(*pOperand - (lastResult + 1)));
+            lastResult = *pOperand++;
+        }
+        for (uint32_t i = 0; i < idCount; ++i)
+            writeVarint(compressed, zigzagEncode(lastResult - *pOperand++));
+        if (layout.stringLiterals)
+        {
+            for (; pOperand < pEnd; ++pOperand)
+                writeWord(compressed, *pOperand);
+        }
+        else
+        {
+            for (; pOperand < pEnd; ++pOperand)
+                writeVarint(compressed, *pOperand);
+        }
+        offset += instructionWordCount;
+    }
+    return true;
+}
+
+bool decompressSpirv(const void* data, size_t size, std::vector<uint8_t>& spirv)
+{
+    if (!isCompressedSpirv(data, size))
+        return false;
+
+    CompressedHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.wordCount < kSpirvHeaderWords)
+        return false;
+    // Every word after the SPIR-V header takes at least one byte, so a corrupt word count is rejected before allocating.
+    if (header.wordCount - kSpirvHeaderWords > size - sizeof(header))
+        return false;
+
+    std::vector<uint32_t> words(header.wordCount);
+    std::memcpy(words.data(), header.spirvHeader, sizeof(header.spirvHeader));
+
+    const uint8_t* pData = static_cast<const uint8_t*>(data) + sizeof(header);
+    const uint8_t* pDataEnd = static_cast<const uint8_t*>(data) + size;
+    uint32_t lastResult = 0;
+    size_t offset = kSpirvHeaderWords;
+    while (offset < words.size())
+    {
+        uint32_t tag;
+        if (!readVarint(pData, pDataEnd, tag))
+            return false;
+        const uint32_t opcode = tag >> 4;
+        uint32_t instructionWordCount = tag & kInlineWordCountLimit;
+        if (instructionWordCount == kInlineWordCountLimit)
+        {
+            uint32_t extraWordCount;
+            if (!readVarint(pData, pDataEnd, extraWordCount))
+                return false;
+            instructionWordCount += extraWordCount;
+        }
+        if (instructionWordCount == 0 || instructionWordCount > words.size() - offset || opcode > 0xffff)
+            return false;
+        words[offset] = opcode | (instructionWordCount << 16);
+
+        const OpcodeLayout& layout = getOpcodeLayout(opcode);
+        uint32_t typeCount, resultCount, idCount;
+        getOperandCounts(layout, instructionWordCount - 1, typeCount, resultCount, idCount);
+
+        uint32_t* pOperand = words.data() + offset + 1;
+        uint32_t* pEnd = words.data() + offset + instructionWordCount;
+        uint32_t value;
+        if (typeCount)
+        {
+            if (!readVarint(pData, pDataEnd, value))
+                return false;
+            *pOperand++ = value;
+        }
+        if (resultCount)
+        {
+            if (!readVarint(pData, pDataEnd, value))
+                return false;
+            lastResult = zigzagDecode(value) + lastResult + 1;
+            *pOperand++ = lastResult;
+        }
+        for (uint32_t i = 0; i < idCount; ++i)
+        {
+            if (!readVarint(pData, pDataEnd, value))
+                return false;
+            *pOperand++ = lastResult - zigzagDecode(value);
+        }
+        for (; pOperand < pEnd; ++pOperand)
+        {
+            if (!(layout.stringLiterals ? readWord(pData, pDataEnd, value) : readVarint(pData, pDataEnd, value)))
+                return false;
+            *pOperand = value;
+        }
+        offset += instructionWordCount;
+    }
+    if (pData != pDataEnd)
+        return false;
+
+    spirv.resize(words.size() * sizeof(uint32_t));
+    std::memcpy(spirv.data(), words.data(), spirv.size());
+    return true;
+}
@@ -0,0 +1,47 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Lossless compression for SPIR-V, in the spirit of SMOL-V.
+ *
+ * SPIR-V stores every operand in a 32-bit word, although most operands are small.
+ * Instructions are encoded as a varint holding the opcode and word count, followed by their
+ * operands as varints. For common opcodes, the operands that are IDs are stored relative to
+ * the last result ID, which makes them small since instructions mostly reference recently
+ * defined values. Result IDs are stored as the difference to the next sequential ID. String
+ * operands are stored verbatim. Instructions of unknown opcodes are stored with plain varints,
+ * so any valid SPIR-V module round-trips exactly.
+ *
+ * The output can be compressed further by a general purpose compressor. Decoding is a single
+ * pass over the data with a table lookup per instruction, which makes it much faster than
+ * reading the uncompressed module from a network file system.
+ */
+
+/**
+ * Check if data looks like a SPIR-V module (magic number and whole number of words).
+ */
+bool isSpirv(const void* data, size_t size);
+
+/**
+ * Check if data was produced by `compressSpirv()`.
+ */
+bool isCompressedSpirv(const void* data, size_t size);
+
+/**
+ * Compress a SPIR-V module.
+ * @param[out] compressed Compressed module.
+ * @return False if the data is not a well-formed SPIR-V module.
+ */
+bool compressSpirv(const void* data, size_t size, std::vector<uint8_t>& compressed);
+
+/**
+ * Decompress a SPIR-V module compressed by `compressSpirv()`.
+ * @param[out] spirv Decompressed module.
+ * @return False if the data is not a valid compressed module.
+ */
+bool decompressSpirv(const void* data, size_t size, std::vector<uint8_t>& spirv);
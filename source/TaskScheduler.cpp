@@ -0,0 +1,249 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#include <algorithm>
+
+#include "TaskScheduler.h"
+
+namespace
+{
+/// Scheduler and worker index of the calling thread, if it is a worker.
+thread_local const TaskScheduler* tlScheduler = nullptr;
+thread_local uint32_t tlWorkerIndex = 0;
+} // namespace
+
+TaskScheduler::TaskScheduler(uint32_t workerCount)
+{
+    if (workerCount == 0)
+        workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (uint32_t i = 0; i < workerCount; i++)
+        mWorkers.push_back(std::make_unique<Worker>());
+    for (uint32_t i = 0; i < workerCount; i++)
+        mWorkers[i]->thread = std::thread(&TaskScheduler::workerLoop, this, i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mWakeMutex);
+        mStop = true;
+    }
+    mWakeCondition.notify_all();
+    for (auto& pWorker : mWorkers)
+        pWorker->thread.join();
+}
+
+uint32_t TaskScheduler::getCurrentWorkerIndex() const
+{
+    return tlScheduler == this ? tlWorkerIndex : getWorkerCount();
+}
+
+TaskScheduler::TaskHandle TaskScheduler::submit(std::string name, std::function<void()> function, const std::vector<TaskHandle>& dependencies)
+{
+    TaskHandle pTask = std::make_shared<Task>();
+    pTask->mName = std::move(name);
+    pTask->mFunction = std::move(function);
+    for (const TaskHandle& pDependency : dependencies)
+    {
+        std::lock_guard<std::mutex> lock(pDependency->mMutex);
+        if (!pDependency->mFinished)
+        {
+            pTask->mPendingCount++;
+            pDependency->mDependents.push_back(pTask);
+        }
+    }
+    // Dependencies finishing meanwhile can't queue the task before the submission reference is dropped.
+    if (--pTask->mPendingCount == 0)
+        enqueue(pTask);
+    return pTask;
+}
+
+void TaskScheduler::enqueue(const TaskHandle& pTask)
+{
+    pTask->mReadyTime = CpuTimer::getCurrentTimePoint();
+    uint32_t workerIndex = getCurrentWorkerIndex();
+    if (workerIndex == getWorkerCount())
+        workerIndex = mNextWorker++ % getWorkerCount();
+    {
+        std::lock_guard<std::mutex> lock(mWorkers[workerIndex]->mutex);
+        mWorkers[workerIndex]->deque.push_back(pTask);
+    }
+    pTask->mQueued = true;
+    mQueuedCount++;
+    {
+        // Taking the lock makes sure a thread about to sleep sees the new task.
+        std::lock_guard<std::mutex> lock(mWakeMutex);
+    }
+    mWakeCondition.notify_all();
+}
+
+TaskScheduler::TaskHandle TaskScheduler::takeTask(uint32_t workerIndex)
+{
+    // Tasks run by a waiting worker stay in their deque and are skipped here.
+    const uint32_t workerCount = getWorkerCount();
+    Worker& worker = *mWorkers[workerIndex];
+    while (true)
+    {
+        TaskHandle pTask;
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.deque.empty())
+                break;
+            pTask = std::move(worker.deque.back());
+            worker.deque.pop_back();
+        }
+        mQueuedCount--;
+        if (!pTask->mStarted.exchange(true))
+            return pTask;
+    }
+
+    // Steal the oldest task of another worker, which tends to be the largest piece of work.
+    for (uint32_t i = 1; i < workerCount; i++)
+    {
+        Worker& victim = *mWorkers[(workerIndex + i) % workerCount];
+        while (true)
+        {
+            TaskHandle pTask;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (victim.deque.empty())
+                    break;
+                pTask = std::move(victim.deque.front());
+                victim.deque.pop_front();
+            }
+            mQueuedCount--;
+            if (!pTask->mStarted.exchange(true))
+            {
+                std::lock_guard<std::mutex> statsLock(mStatsMutex);
+                mStats.stealCount++;
+                return pTask;
+            }
+        }
+    }
+    return nullptr;
+}
+
+TaskScheduler::TaskHandle TaskScheduler::takeAwaitedTask(const std::vector<TaskHandle>& tasks)
+{
+    for (const TaskHandle& pTask : tasks)
+    {
+        if (pTask->mQueued && !pTask->mStarted && !pTask->mStarted.exchange(true))
+            return pTask;
+    }
+    return nullptr;
+}
+
+void TaskScheduler::run(const TaskHandle& pTask)
+{
+    CpuTimer::TimePoint startTime = CpuTimer::getCurrentTimePoint();
+    pTask->mFunction();
+    pTask->mFunction = nullptr;
+    CpuTimer::TimePoint endTime = CpuTimer::getCurrentTimePoint();
+    pTask->mQueueTime = CpuTimer::calcDuration(pTask->mReadyTime, startTime) * 1.0e-3;
+    pTask->mRunTime = CpuTimer::calcDuration(startTime, endTime) * 1.0e-3;
+
+    recordTask(pTask->mName, pTask->mQueueTime, pTask->mRunTime);
+
+    std::vector<TaskHandle> dependents;
+    {
+        std::lock_guard<std::mutex> lock(pTask->mMutex);
+        pTask->mFinished = true;
+        dependents.swap(pTask->mDependents);
+    }
+    for (const TaskHandle& pDependent : dependents)
+    {
+        if (--pDependent->mPendingCount == 0)
+            enqueue(pDependent);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mWakeMutex);
+    }
+    mWakeCondition.notify_all();
+}
+
+void TaskScheduler::workerLoop(uint32_t workerIndex)
+{
+    tlScheduler = this;
+    tlWorkerIndex = workerIndex;
+    while (true)
+    {
+        if (TaskHandle pTask = takeTask(workerIndex))
+        {
+            run(pTask);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mWakeMutex);
+        mWakeCondition.wait(lock, [this] { return mStop || mQueuedCount > 0; });
+        if (mStop && mQueuedCount == 0)
+            return;
+    }
+}
+
+void TaskScheduler::wait(const TaskHandle& pTask)
+{
+    wait(std::vector<TaskHandle>{pTask});
+}
+
+void TaskScheduler::wait(const std::vector<TaskHandle>& tasks)
+{
+    const bool isWorker = getCurrentWorkerIndex() < getWorkerCount();
+    for (const TaskHandle& pTask : tasks)
+    {
+        while (!pTask->mFinished)
+        {
+            // Workers only run the awaited tasks. Other queued tasks (e.g. precompiles) may take much
+            // longer and would delay the waiter; idle workers pick them up.
+            if (isWorker)
+            {
+                if (TaskHandle pAwaited = takeAwaitedTask(tasks))
+                {
+                    run(pAwaited);
+                    continue;
+                }
+            }
+
+            std::unique_lock<std::mutex> lock(mWakeMutex);
+            mWakeCondition.wait(
+                lock,
+                [&]
+                {
+                    if (pTask->mFinished)
+                        return true;
+                    if (!isWorker)
+                        return false;
+                    for (const TaskHandle& pOther : tasks)
+                    {
+                        if (pOther->mQueued && !pOther->mStarted)
+                            return true;
+                    }
+                    return false;
+                }
+            );
+        }
+    }
+}
+
+void TaskScheduler::recordTask(const std::string& name, double queueTime, double runTime)
+{
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    mStats.taskCount++;
+    TaskStats& stats = mStats.tasks[name];
+    stats.count++;
+    stats.totalQueueTime += queueTime;
+    stats.totalRunTime += runTime;
+    stats.maxRunTime = std::max(stats.maxRunTime, runTime);
+}
+
+TaskScheduler::Stats TaskScheduler::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    return mStats;
+}
+
+void TaskScheduler::resetStats()
+{
+    std::lock_guard<std::mutex> lock(mStatsMutex);
+    mStats = {};
+}
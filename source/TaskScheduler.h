@@ -0,0 +1,176 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CpuTimer.h"
+
+/**
+ * Work-stealing thread pool for compile, code generation and pipeline creation jobs.
+ *
+ * Jobs in this project vary in size by orders of magnitude (a front-end pass over the material
+ * modules takes seconds, loading a kernel from the shader cache takes microseconds), so work
+ * is not distributed up front. Each worker has a deque of ready tasks: it pushes the tasks it
+ * submits to the back and runs tasks from the back, and idle workers steal from the front of
+ * the other deques. Tasks submitted from threads outside the pool are distributed round-robin.
+ *
+ * A task can depend on other tasks, and is queued once all of them have finished. Workers
+ * waiting for tasks run the awaited tasks that are queued themselves, so tasks can submit and
+ * wait for subtasks without starving the pool. They don't run other tasks meanwhile, which may
+ * take much longer than the awaited ones. Threads outside the pool just block. Tasks must not
+ * wait while holding a lock another task may need.
+ *
+ * Each task records the time it waited in a deque and the time it ran, and the scheduler
+ * accumulates the times per task name. Work that runs outside the pool can be recorded with
+ * `recordTask()`.
+ */
+class TaskScheduler
+{
+public:
+    /**
+     * A submitted task. Handles are shared by the scheduler, the submitter and dependent tasks.
+     */
+    class Task
+    {
+    public:
+        const std::string& getName() const { return mName; }
+
+        /// True once the function of the task has returned.
+        bool isFinished() const { return mFinished; }
+
+        /// Time from the task becoming ready (all dependencies finished) to it starting, in seconds. Valid once finished.
+        double getQueueTime() const { return mQueueTime; }
+
+        /// Time the function of the task ran, in seconds. Valid once finished.
+        double getRunTime() const { return mRunTime; }
+
+    private:
+        friend class TaskScheduler;
+
+        std::string mName;
+        std::function<void()> mFunction;
+        std::atomic<uint32_t> mPendingCount{1}; ///< Unfinished dependencies, plus one until submitting is done.
+        std::atomic<bool> mQueued{false};   ///< Set once the task is in a deque.
+        std::atomic<bool> mStarted{false};  ///< Set by the thread running the task, deque entries of started tasks are skipped.
+        std::atomic<bool> mFinished{false};
+        std::mutex mMutex;                             ///< Guards mDependents and the transition to finished.
+        std::vector<std::shared_ptr<Task>> mDependents; ///< Tasks waiting for this one.
+        CpuTimer::TimePoint mReadyTime;
+        double mQueueTime = 0.0;
+        double mRunTime = 0.0;
+    };
+    using TaskHandle = std::shared_ptr<Task>;
+
+    /**
+     * Times of all finished tasks with the same name.
+     */
+    struct TaskStats
+    {
+        size_t count = 0;
+        double totalQueueTime = 0.0;
+        double totalRunTime = 0.0;
+        double maxRunTime = 0.0;
+    };
+
+    struct Stats
+    {
+        size_t taskCount = 0;                  ///< Finished tasks.
+        size_t stealCount = 0;                 ///< Tasks a worker took from the deque of another worker.
+        std::map<std::string, TaskStats> tasks; ///< Times per task name.
+    };
+
+    /**
+     * @param[in] workerCount Number of worker threads. One per hardware thread if zero.
+     */
+    explicit TaskScheduler(uint32_t workerCount = 0);
+
+    /**
+     * Wait for all queued tasks, then stop the workers.
+     */
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    uint32_t getWorkerCount() const { return uint32_t(mWorkers.size()); }
+
+    /**
+     * Get the index of the worker running the calling thread.
+     * @return The worker index, or `getWorkerCount()` if the calling thread isn't a worker of this scheduler.
+     */
+    uint32_t getCurrentWorkerIndex() const;
+
+    /**
+     * Submit a task.
+     * @param[in] name Name the times of the task are accumulated under.
+     * @param[in] function Function run by a worker.
+     * @param[in] dependencies Tasks that must finish before the task starts.
+     * @return Handle of the task.
+     */
+    TaskHandle submit(std::string name, std::function<void()> function, const std::vector<TaskHandle>& dependencies = {});
+
+    /**
+     * Wait for a task to finish. Workers run the task themselves if it is queued.
+     */
+    void wait(const TaskHandle& pTask);
+
+    /**
+     * Wait for a list of tasks to finish. Workers run the queued tasks of the list meanwhile.
+     */
+    void wait(const std::vector<TaskHandle>& tasks);
+
+    /**
+     * Record the times of work that ran outside the scheduler under a task name, so that it
+     * shows up in the statistics with the tasks. Used for short jobs that must not queue
+     * behind long tasks, e.g. pipeline creation on the render thread.
+     * @param[in] queueTime Time the work waited before it started, in seconds.
+     * @param[in] runTime Time the work ran, in seconds.
+     */
+    void recordTask(const std::string& name, double queueTime, double runTime);
+
+    Stats getStats() const;
+    void resetStats();
+
+private:
+    struct Worker
+    {
+        std::mutex mutex; ///< Guards the deque.
+        std::deque<TaskHandle> deque;
+        std::thread thread;
+    };
+
+    void workerLoop(uint32_t workerIndex);
+    void enqueue(const TaskHandle& pTask);
+    /**
+     * Take a ready task, from the back of the deque of `workerIndex` if possible, otherwise from
+     * the front of another deque. The task is marked as started.
+     */
+    TaskHandle takeTask(uint32_t workerIndex);
+    /**
+     * Take a queued task of a list that no thread started yet. The task is marked as started.
+     */
+    static TaskHandle takeAwaitedTask(const std::vector<TaskHandle>& tasks);
+    void run(const TaskHandle& pTask);
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::atomic<uint32_t> mNextWorker{0};  ///< Deque receiving the next task submitted from outside the pool.
+    std::atomic<size_t> mQueuedCount{0};   ///< Tasks in all deques.
+
+    std::mutex mWakeMutex;                 ///< Guards mStop and is held when waking sleeping threads.
+    std::condition_variable mWakeCondition; ///< Signaled when a task is queued or finished.
+    bool mStop = false;
+
+    mutable std::mutex mStatsMutex;
+    Stats mStats;
+};
@@ -44,6 +44,14 @@ enum class RtPipelineFlags
     SkipProceduralPrimitives = 0x2,
 };
 
+/// How the entry points of a program are linked for code generation.
+enum class ProgramLinkingStyle
+{
+    Default,             ///< Use the linking style set on the program manager.
+    SeparateEntryPoints, ///< Link each entry point with its own copy of the global scope and generate one module per entry point.
+    WholeProgram,        ///< Link all entry points with one global scope and generate a single module containing all entry points.
+};
+
 enum SlangCompilerFlags: uint32_t
 {
     None = 0x0,
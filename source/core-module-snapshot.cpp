@@ -0,0 +1,28 @@
+/***************************************************************************
+ # Copyright 2024 The Khronos Group, Inc.
+ **************************************************************************/
+#include <stdio.h>
+#include <slang.h>
+#include <slang-com-ptr.h>
+#include "CoreModuleSnapshot.h"
+
+// Writes the snapshot of the Slang core module that falcor_perftest loads at startup.
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        printf("Usage: %s <file>\n", argv[0]);
+        return 1;
+    }
+
+    Slang::ComPtr<slang::IGlobalSession> slangGlobalSession;
+    if (SLANG_FAILED(slang::createGlobalSession(slangGlobalSession.writeRef())))
+    {
+        printf("Failed to create the Slang global session\n");
+        return 1;
+    }
+    if (!saveCoreModuleSnapshot(slangGlobalSession, argv[1]))
+        return 1;
+    printf("Wrote core module snapshot %s\n", argv[1]);
+    return 0;
+}
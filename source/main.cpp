@@ -1,11 +1,20 @@
 #include <stdio.h>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <set>
+#include <thread>
 #include <slang-gfx.h>
 #include <slang-com-ptr.h>
 #include "Program.h"
 #include "path-tracer.h"
 #include "ProgramManager.h"
 #include "DeviceWrapper.h"
+#include "CoreModuleSnapshot.h"
 #include "CpuTimer.h"
+#include "ShaderCache.h"
+#include "SpirvCompression.h"
 #include "Utility.h"
 
 // Hard-code the type conformance list. The list is dumped from Falcor
@@ -51,7 +60,157 @@ void LoadShaderModules(ProgramDesc& desc)
     desc.addShaderLibrary("RenderPasses/PathTracer/TracePassSimpleInline.cs.slang").csEntry("main");
 }
 
-void TestCase(ref<Device>& device)
+struct Options
+{
+    std::filesystem::path shaderCacheDirectory; ///< Persistent shader cache directory. Disabled if empty.
+    std::filesystem::path moduleCacheDirectory; ///< Slang module cache directory. Disabled if empty.
+    std::filesystem::path pipelineCachePath;    ///< Vulkan pipeline cache file. Not persisted if empty.
+    std::filesystem::path gfxShaderCacheDirectory; ///< gfx shader code cache directory. Not persisted if empty.
+    uint64_t gfxShaderCacheMaxBytes = 512ull * 1024 * 1024; ///< Size budget of the gfx shader code cache.
+    std::filesystem::path permutationManifestPath; ///< Permutation manifest file. Disabled if empty.
+    uint32_t permutationSweepCount = 0;            ///< Number of permutations compiled by the permutation sweep.
+    size_t programVersionBudget = 0;               ///< Memory budget of program versions in bytes. Unlimited if zero.
+    uint32_t cacheStressIterations = 0;            ///< Iterations of the shader cache stress test. Disabled if zero.
+    uint32_t stressThreadCount = 0;                ///< Threads of the concurrent compilation stress test. Disabled if zero.
+    uint32_t taskWorkerCount = 0;                  ///< Worker threads of the task scheduler. One per hardware thread if zero.
+    bool batchCompile = false;                     ///< Compare serial and parallel batch compilation.
+    bool codegenBenchmark = false;                 ///< Compare lazy and eager code generation.
+    bool asyncSwap = false;                        ///< Compare blocking and asynchronous active version changes.
+    bool spirvBenchmark = false;                   ///< Benchmark SPIR-V compression of the path tracer kernel.
+    bool compareFrontEnds = false;                 ///< Compare program version creation with compile requests and sessions.
+    bool linkingBenchmark = false;                 ///< Compare separate entry point and whole-program linking.
+    /// Slang core module snapshot. The core module is compiled if empty.
+    std::filesystem::path coreModuleSnapshotPath = getExecutablePath().parent_path() / "slang-core-module.bin";
+    bool startupBenchmark = false;                 ///< Compare global session creation with and without the core module snapshot.
+    bool codeOnlyBenchmark = false;                ///< Compare kernel creation with and without the code-only mode.
+    bool multiTarget = false;                      ///< Compile the path tracer for both SPIR-V backends from one front-end pass.
+};
+
+bool ParseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--shader-cache" && i + 1 < argc)
+        {
+            options.shaderCacheDirectory = argv[++i];
+        }
+        else if (arg == "--module-cache" && i + 1 < argc)
+        {
+            options.moduleCacheDirectory = argv[++i];
+        }
+        else if (arg == "--pipeline-cache" && i + 1 < argc)
+        {
+            options.pipelineCachePath = argv[++i];
+        }
+        else if (arg == "--gfx-shader-cache" && i + 1 < argc)
+        {
+            options.gfxShaderCacheDirectory = argv[++i];
+        }
+        else if (arg == "--gfx-shader-cache-size" && i + 1 < argc)
+        {
+            options.gfxShaderCacheMaxBytes = std::stoull(argv[++i]) * 1024 * 1024;
+        }
+        else if (arg == "--permutation-manifest" && i + 1 < argc)
+        {
+            options.permutationManifestPath = argv[++i];
+        }
+        else if (arg == "--permutation-sweep" && i + 1 < argc)
+        {
+            options.permutationSweepCount = uint32_t(std::stoul(argv[++i]));
+        }
+        else if (arg == "--version-budget" && i + 1 < argc)
+        {
+            options.programVersionBudget = size_t(std::stoull(argv[++i])) * 1024 * 1024;
+        }
+        else if (arg == "--compare-front-ends")
+        {
+            options.compareFrontEnds = true;
+        }
+        else if (arg == "--core-module-snapshot" && i + 1 < argc)
+        {
+            options.coreModuleSnapshotPath = argv[++i];
+        }
+        else if (arg == "--no-core-module-snapshot")
+        {
+            options.coreModuleSnapshotPath.clear();
+        }
+        else if (arg == "--multi-target")
+        {
+            options.multiTarget = true;
+        }
+        else if (arg == "--code-only-benchmark")
+        {
+            options.codeOnlyBenchmark = true;
+        }
+        else if (arg == "--startup-benchmark")
+        {
+            options.startupBenchmark = true;
+        }
+        else if (arg == "--linking-benchmark")
+        {
+            options.linkingBenchmark = true;
+        }
+        else if (arg == "--spirv-benchmark")
+        {
+            options.spirvBenchmark = true;
+        }
+        else if (arg == "--cache-stress" && i + 1 < argc)
+        {
+            options.cacheStressIterations = uint32_t(std::stoul(argv[++i]));
+        }
+        else if (arg == "--stress-threads" && i + 1 < argc)
+        {
+            options.stressThreadCount = uint32_t(std::stoul(argv[++i]));
+        }
+        else if (arg == "--task-workers" && i + 1 < argc)
+        {
+            options.taskWorkerCount = uint32_t(std::stoul(argv[++i]));
+        }
+        else if (arg == "--batch-compile")
+        {
+            options.batchCompile = true;
+        }
+        else if (arg == "--codegen-benchmark")
+        {
+            options.codegenBenchmark = true;
+        }
+        else if (arg == "--async-swap")
+        {
+            options.asyncSwap = true;
+        }
+        else
+        {
+            printf("Usage: %s [--shader-cache <dir>] [--module-cache <dir>] [--pipeline-cache <file>] [--gfx-shader-cache <dir>] [--gfx-shader-cache-size <MB>] [--permutation-manifest <file>] [--permutation-sweep <count>] [--version-budget <MB>] [--cache-stress <iterations>] [--stress-threads <count>] [--task-workers <count>] [--batch-compile] [--codegen-benchmark] [--async-swap] [--spirv-benchmark] [--compare-front-ends] [--linking-benchmark] [--core-module-snapshot <file>] [--no-core-module-snapshot] [--startup-benchmark] [--code-only-benchmark] [--multi-target]\n", argv[0]);
+            printf("  --shader-cache <dir>  Enable the persistent kernel cache in <dir>.\n");
+            printf("  --module-cache <dir>  Enable the Slang module cache in <dir>.\n");
+            printf("  --pipeline-cache <file>  Load and save the Vulkan pipeline cache from/to <file>.\n");
+            printf("  --gfx-shader-cache <dir>  Persist the gfx shader code cache in <dir>.\n");
+            printf("  --gfx-shader-cache-size <MB>  Size budget of the gfx shader code cache (default 512).\n");
+            printf("  --permutation-manifest <file>  Record compiled permutations in <file> and precompile them on startup.\n");
+            printf("  --permutation-sweep <count>  Compile <count> permutations with identical kernel code and report code sharing.\n");
+            printf("  --version-budget <MB>  Memory budget of compiled program versions (default unlimited).\n");
+            printf("  --cache-stress <iterations>  Load and store entries in the shader cache directory and validate them, then exit.\n");
+            printf("  --stress-threads <count>  Compile programs from <count> threads at once and check the results.\n");
+            printf("  --task-workers <count>  Worker threads of the task scheduler (default one per hardware thread).\n");
+            printf("  --batch-compile  Compile a batch of programs serially and on the task scheduler and report the speedup.\n");
+            printf("  --codegen-benchmark  Compare lazy code generation of the SVGF kernels with ProgramKernels::generateAll() on the task scheduler.\n");
+            printf("  --async-swap  Compare the frame time of a define change with getActiveVersion() and with requestActiveVersion().\n");
+            printf("  --spirv-benchmark  Report compression ratio and throughput of SPIR-V compression for the path tracer kernel.\n");
+            printf("  --compare-front-ends  Compare program version creation with compile requests and with sessions.\n");
+            printf("  --linking-benchmark  Compare code generation time and code size of separate entry point and whole-program linking.\n");
+            printf("  --core-module-snapshot <file>  Load the Slang core module from <file> (default slang-core-module.bin next to the executable).\n");
+            printf("  --no-core-module-snapshot  Compile the Slang core module instead of loading the snapshot.\n");
+            printf("  --startup-benchmark  Compare Slang global session creation with and without the core module snapshot.\n");
+            printf("  --code-only-benchmark  Compare kernel creation and code generation with and without the code-only kernel mode.\n");
+            printf("  --multi-target  Generate the path tracer kernel with both SPIR-V backends from a single front-end pass.\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+ref<Program> CreatePathTracerProgram(ref<Device>& device)
 {
     TypeConformanceList typeConformances {};
     InitTypeConformanceList(typeConformances);
@@ -64,7 +223,22 @@ void TestCase(ref<Device>& device)
 
     desc.addTypeConformances(typeConformances);
 
-    ref<Program> pProg = Program::create(device, desc, defines);
+    return Program::create(device, desc, defines);
+}
+
+void TestCase(ref<Device>& device)
+{
+    ref<Program> pProg = CreatePathTracerProgram(device);
+
+    if (device->getProgramManager()->getPermutationManifest())
+    {
+        // Permutations recorded by previous runs are compiled in the background as soon as the program is created.
+        CpuTimer timer;
+        timer.update();
+        device->getProgramManager()->waitForPrecompile();
+        timer.update();
+        printf("Time waiting for background precompile: %.3fs\n", timer.delta());
+    }
 
     std::vector<std::string> backendName = {"glslang", "slang"};
     for (uint32_t i = 0; i < 2; i++)
@@ -74,19 +248,55 @@ void TestCase(ref<Device>& device)
         // Each set of pair of `Macro defines` and `Type conformance object` can define
         // one version of program.
         printf("Start creating program versions\n");
-        const ref<const ProgramVersion>& progVersion = pProg->getActiveVersion();
+        ref<const ProgramVersion> progVersion = pProg->getActiveVersion();
         timer.update();
         double programVersionTime = timer.delta();
         printf("Time for program version creation (%s): %.3fs\n", backendName[i].c_str(), programVersionTime);
 
-        std::string log;
-        ref<const ProgramKernels> programKernel = device->getProgramManager()->createProgramKernels(*pProg, *progVersion, log);
+        ref<const ProgramKernels> programKernel = progVersion->getKernels(pProg->getTypeConformances());
         const EntryPointKernel* entryPointKernel = programKernel->getKernel(ShaderType::Compute);
         timer.update();
         double programKernelTime = timer.delta();
         printf("Time for program kernel creation (%s): %.3fs\n", backendName[i].c_str(), programKernelTime);
         printf("Time for frontend execution:%.3fs\n",  programKernelTime + programVersionTime);
 
+        // Requesting the same specialization again must be served from the version's kernel cache.
+        ref<const ProgramKernels> memoizedKernel = progVersion->getKernels(pProg->getTypeConformances());
+        ASSERT(memoizedKernel == programKernel);
+        timer.update();
+        printf("Time for memoized program kernel lookup (%s): %.6fs\n", backendName[i].c_str(), timer.delta());
+
+        // Adding and removing a define must restore the version fingerprint, and with it the active version.
+        const ref<const ProgramVersion> pVersion = progVersion;
+        const Hash128 fingerprint = pProg->getVersionFingerprint();
+        pProg->addDefine("PERFTEST_FINGERPRINT_CHECK", "1");
+        ASSERT(pProg->getVersionFingerprint() != fingerprint);
+        timer.update();
+        pProg->removeDefine("PERFTEST_FINGERPRINT_CHECK");
+        ASSERT(pProg->getActiveVersion() == pVersion);
+        timer.update();
+        printf("Time for program version lookup (%s): %.6fs\n", backendName[i].c_str(), timer.delta());
+
+        if (!programKernel->getGfxProgram())
+        {
+            // Kernels served from the shader cache only carry code, there is no gfx program to create a pipeline with.
+            EntryPointKernel::BlobData blob = entryPointKernel->getBlobData();
+            timer.update();
+            printf("Time for loading kernel code from shader cache (%s): %.3fs (%zu bytes)\n\n\n", backendName[i].c_str(), timer.delta(), blob.size);
+
+            device->getProgramManager()->reloadAllPrograms();
+            device->getProgramManager()->setSpirvDirectMode(true);
+            continue;
+        }
+
+        if (device->getProgramManager()->getShaderCache())
+        {
+            // Generate the kernel code once through the kernel to populate the shader cache.
+            EntryPointKernel::BlobData blob = entryPointKernel->getBlobData();
+            timer.update();
+            printf("Time for kernel code generation (%s): %.3fs (%zu bytes)\n", backendName[i].c_str(), timer.delta(), blob.size);
+        }
+
         Slang::ComPtr<gfx::IShaderObject> shaderObject;
         SlangResult res = device->getGfxDevice()->createMutableRootShaderObject(programKernel->getGfxProgram(), shaderObject.writeRef());
         ASSERT_EQ(res, SLANG_OK, "createMutableRootShaderObject");
@@ -124,13 +334,657 @@ void TestCase(ref<Device>& device)
         device->getProgramManager()->reloadAllPrograms();
         device->getProgramManager()->setSpirvDirectMode(true);
     }
+
+    // Make sure the program is compiled, then change a global define that no shader references.
+    // The program must be kept.
+    pProg->getActiveVersion();
+    ProgramManager::ReloadResult reloadResult = device->getProgramManager()->addGlobalDefines({{"PERFTEST_UNREFERENCED_DEFINE", "1"}});
+    printf("Global define change: %zu programs kept, %zu programs rebuilt\n", reloadResult.kept, reloadResult.rebuilt);
+    device->getProgramManager()->removeGlobalDefines({{"PERFTEST_UNREFERENCED_DEFINE", "1"}});
+}
+
+/**
+ * Compile a number of permutations that differ only in a define no shader references, and
+ * report how much of their kernel code is shared.
+ */
+void PermutationSweep(ref<Device>& device, uint32_t permutationCount)
+{
+    ref<Program> pProg = CreatePathTracerProgram(device);
+
+    CpuTimer timer;
+    timer.update();
+    std::vector<ref<const ProgramKernels>> kernels;
+    for (uint32_t i = 0; i < permutationCount; i++)
+    {
+        pProg->addDefine("PERFTEST_SWEEP_INDEX", std::to_string(i));
+        ref<const ProgramKernels> pKernels = pProg->getActiveVersion()->getKernels(pProg->getTypeConformances());
+        pKernels->getKernel(ShaderType::Compute)->getBlobData();
+        kernels.push_back(pKernels);
+    }
+    timer.update();
+
+    CodeBlobStore::Stats stats = device->getProgramManager()->getCodeBlobStore().getStats();
+    printf("Permutation sweep: %u permutations in %.3fs, %zu distinct kernel blobs (%.2f MB), %.2f MB without sharing, dedup ratio %.2f\n",
+        permutationCount, timer.delta(), stats.liveBlobCount, stats.liveBytes / (1024.0 * 1024.0), stats.referencedBytes / (1024.0 * 1024.0),
+        stats.getDedupRatio());
+}
+
+/**
+ * Create the path tracer program version with the compile request API and with the session
+ * API, and compare the creation times and the generated code.
+ */
+void CompareFrontEnds(ref<Device>& device)
+{
+    ProgramManager* pProgramManager = device->getProgramManager();
+    const bool compileRequestMode = pProgramManager->isCompileRequestMode();
+    const size_t sessionPoolSize = pProgramManager->getSessionPoolSize();
+
+    // Don't let either run reuse modules loaded into pooled sessions.
+    pProgramManager->setSessionPoolSize(0);
+
+    std::vector<uint8_t> code[2];
+    const char* names[2] = {"compile request", "session"};
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        pProgramManager->setCompileRequestMode(i == 0);
+
+        CpuTimer timer;
+        timer.update();
+        ref<Program> pProg = CreatePathTracerProgram(device);
+        ref<const ProgramVersion> pVersion = pProg->getActiveVersion();
+        timer.update();
+        double versionTime = timer.delta();
+
+        ref<const ProgramKernels> pKernels = pVersion->getKernels(pProg->getTypeConformances());
+        EntryPointKernel::BlobData blob = pKernels->getKernel(ShaderType::Compute)->getBlobData();
+        timer.update();
+        double kernelTime = timer.delta();
+
+        code[i].assign(static_cast<const uint8_t*>(blob.data), static_cast<const uint8_t*>(blob.data) + blob.size);
+        printf("Front end (%s): program version %.3fs, kernel %.3fs, %zu bytes of code%s\n", names[i], versionTime, kernelTime,
+            blob.size, pVersion->isCacheBacked() ? " (created from the shader cache)" : "");
+    }
+    printf("Front end comparison: generated code is %s\n", code[0] == code[1] ? "identical" : "different");
+
+    pProgramManager->setCompileRequestMode(compileRequestMode);
+    pProgramManager->setSessionPoolSize(sessionPoolSize);
+}
+
+/**
+ * Create a program with the SVGF pixel shaders as entry points, one shader module each.
+ */
+ref<Program> CreateSVGFProgram(ref<Device>& device, ProgramLinkingStyle linkingStyle)
+{
+    const char* passes[] = {"SVGFPackLinearZAndNormal", "SVGFReproject", "SVGFFilterMoments", "SVGFAtrous", "SVGFFinalModulate"};
+
+    ProgramDesc desc;
+    for (const char* pass : passes)
+    {
+        desc.addShaderLibrary(std::string("RenderPasses/SVGFPass/") + pass + ".ps.slang");
+        desc.addEntryPointGroup().addEntryPoint(ShaderType::Pixel, "main", pass);
+    }
+    desc.setLinkingStyle(linkingStyle);
+    return Program::create(device, desc, DefineList());
+}
+
+/**
+ * Generate the kernels of a multi-entry-point program with separate entry point linking and
+ * with whole-program linking, and compare the code generation time and the total code size.
+ */
+void LinkingBenchmark(ref<Device>& device)
+{
+    const ProgramLinkingStyle styles[2] = {ProgramLinkingStyle::SeparateEntryPoints, ProgramLinkingStyle::WholeProgram};
+    const char* names[2] = {"separate entry points", "whole program"};
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        ref<Program> pProg = CreateSVGFProgram(device, styles[i]);
+        ref<const ProgramVersion> pVersion = pProg->getActiveVersion();
+
+        CpuTimer timer;
+        timer.update();
+        ref<const ProgramKernels> pKernels = pVersion->getKernels(pProg->getTypeConformances());
+        size_t kernelCount = 0;
+        size_t codeSize = 0;
+        std::set<const void*> modules;
+        for (const auto& pGroup : pKernels->getUniqueEntryPointGroups())
+        {
+            for (size_t k = 0; k < pGroup->getKernelCount(); k++)
+            {
+                // Kernels sharing the module of the whole program share its code blob.
+                EntryPointKernel::BlobData blob = pGroup->getKernelByIndex(k)->getBlobData();
+                if (modules.insert(blob.data).second)
+                    codeSize += blob.size;
+                kernelCount++;
+            }
+        }
+        timer.update();
+
+        printf("Linking (%s): %zu kernels, codegen %.3fs, %zu modules, %.2f KB of SPIR-V%s\n", names[i], kernelCount, timer.delta(),
+            modules.size(), codeSize / 1024.0, pVersion->isCacheBacked() ? " (created from the shader cache)" : "");
+    }
+}
+
+/**
+ * Compile programs from several threads at once. Each thread compiles programs of its own and
+ * requests the active version of a program shared by all threads, which must be compiled once.
+ * @return True if all programs compiled and all threads got the same version of the shared program.
+ */
+bool ConcurrencyStress(ref<Device>& device, uint32_t threadCount)
+{
+    const uint32_t kProgramsPerThread = 4;
+    ref<Program> pSharedProg = CreateSVGFProgram(device, ProgramLinkingStyle::Default);
+    std::vector<const ProgramVersion*> sharedVersions(threadCount, nullptr);
+    std::atomic<size_t> kernelCount{0};
+    std::atomic<size_t> failures{0};
+
+    CpuTimer timer;
+    timer.update();
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back(
+            [&, t]()
+            {
+                sharedVersions[t] = pSharedProg->getActiveVersion().get();
+                for (uint32_t i = 0; i < kProgramsPerThread; i++)
+                {
+                    ref<Program> pProg = CreateSVGFProgram(device, ProgramLinkingStyle::Default);
+                    pProg->addDefine("PERFTEST_STRESS_INDEX", std::to_string(t * kProgramsPerThread + i));
+                    ref<const ProgramKernels> pKernels = pProg->getActiveVersion()->getKernels(pProg->getTypeConformances());
+                    if (!pKernels)
+                    {
+                        failures++;
+                        continue;
+                    }
+                    for (const auto& pGroup : pKernels->getUniqueEntryPointGroups())
+                    {
+                        for (size_t k = 0; k < pGroup->getKernelCount(); k++)
+                        {
+                            if (pGroup->getKernelByIndex(k)->getBlobData().size == 0)
+                                failures++;
+                            kernelCount++;
+                        }
+                    }
+                    // Statistics are read while other threads compile.
+                    device->getProgramManager()->getCompilationStats();
+                }
+            }
+        );
+    }
+    for (auto& thread : threads)
+        thread.join();
+    timer.update();
+
+    for (const ProgramVersion* pVersion : sharedVersions)
+    {
+        if (pVersion != sharedVersions[0])
+            failures++;
+    }
+    printf("Concurrency stress: %u threads compiled %u programs (%zu kernels) in %.3fs, %zu failures\n", threadCount,
+        threadCount * kProgramsPerThread + 1, kernelCount.load(), timer.delta(), failures.load());
+    return failures == 0;
+}
+
+/**
+ * Compile a batch of path tracer and SVGF programs with `ProgramManager::compileBatch()`, once
+ * serially on the calling thread and once on the task scheduler, and report the wall-clock speedup.
+ * Each run uses programs with defines of their own, so that the second run doesn't reuse the
+ * program versions of the first.
+ * @return True if all programs compiled.
+ */
+bool BatchCompileBenchmark(ref<Device>& device)
+{
+    const uint32_t kSVGFVariantCount = 7;
+    const uint32_t workerCount = device->getTaskScheduler()->getWorkerCount();
+    double times[2] = {};
+    bool success = true;
+    for (uint32_t run = 0; run < 2; run++)
+    {
+        std::vector<ref<Program>> programs;
+        programs.push_back(CreatePathTracerProgram(device));
+        for (uint32_t i = 0; i < kSVGFVariantCount; i++)
+            programs.push_back(CreateSVGFProgram(device, ProgramLinkingStyle::Default));
+        for (uint32_t i = 0; i < programs.size(); i++)
+            programs[i]->addDefine("PERFTEST_BATCH_INDEX", std::to_string(run * programs.size() + i));
+
+        CpuTimer timer;
+        timer.update();
+        std::vector<ProgramManager::BatchResult> results = device->getProgramManager()->compileBatch(programs, run == 1);
+        timer.update();
+        times[run] = timer.delta();
+
+        double programTime = 0.0;
+        for (const ProgramManager::BatchResult& result : results)
+        {
+            programTime += result.time;
+            if (!result.success)
+            {
+                printf("Batch compile failed:\n%s\n", result.log.c_str());
+                success = false;
+            }
+        }
+        printf("Batch compile (%s): %zu programs in %.3fs, %.3fs of program compile time\n", run == 0 ? "serial" : "task scheduler",
+            programs.size(), times[run], programTime);
+    }
+    printf("Batch compile speedup: %.2fx with %u workers\n", times[0] / times[1], workerCount);
+    return success;
+}
+
+/**
+ * Generate the code of the SVGF kernels, once lazily one kernel at a time and once with
+ * `ProgramKernels::generateAll()` on the task scheduler, and report the time per entry point.
+ * Each run uses a program with defines of its own, so that the second run doesn't reuse the code of the first.
+ * @return True if the code of all kernels was generated.
+ */
+bool EagerCodegenBenchmark(ref<Device>& device)
+{
+    bool success = true;
+    for (uint32_t run = 0; run < 2; run++)
+    {
+        ref<Program> pProg = CreateSVGFProgram(device, ProgramLinkingStyle::SeparateEntryPoints);
+        pProg->addDefine("PERFTEST_CODEGEN_RUN", std::to_string(run));
+        ref<const ProgramKernels> pKernels = pProg->getActiveVersion()->getKernels(pProg->getTypeConformances());
+
+        CpuTimer timer;
+        timer.update();
+        if (run == 0)
+        {
+            for (const auto& pGroup : pKernels->getUniqueEntryPointGroups())
+            {
+                for (size_t k = 0; k < pGroup->getKernelCount(); k++)
+                    success &= pGroup->getKernelByIndex(k)->getBlobData().data != nullptr;
+            }
+        }
+        else
+        {
+            success &= pKernels->generateAll(device->getTaskScheduler());
+        }
+        timer.update();
+
+        printf("Codegen (%s): %.3fs\n", run == 0 ? "lazy" : "generateAll", timer.delta());
+        for (const auto& pGroup : pKernels->getUniqueEntryPointGroups())
+        {
+            for (size_t k = 0; k < pGroup->getKernelCount(); k++)
+            {
+                const EntryPointKernel* pKernel = pGroup->getKernelByIndex(k);
+                printf("  %s: %.3fs\n", pKernel->getEntryPointName().c_str(), pKernel->getCodegenTime());
+            }
+        }
+    }
+    return success;
+}
+
+/**
+ * Change a define of the path tracer, once getting the new version with `getActiveVersion()`,
+ * which blocks the frame, and once with `requestActiveVersion()` while simulated frames keep
+ * using the last good version from `getServedVersion()`. Reports the longest frame of each and
+ * the time from request to swap.
+ * @return True if the requested version was swapped in.
+ */
+bool AsyncSwapBenchmark(ref<Device>& device)
+{
+    ref<Program> pProg = CreatePathTracerProgram(device);
+    pProg->getActiveVersion()->getKernels(pProg->getTypeConformances())->generateAll(device->getTaskScheduler());
+
+    CpuTimer timer;
+    timer.update();
+    pProg->addDefine("PERFTEST_ASYNC_SWAP", "0");
+    pProg->getActiveVersion()->getKernels(pProg->getTypeConformances())->generateAll(device->getTaskScheduler());
+    timer.update();
+    printf("Version change (blocking): %.3fs frame\n", timer.delta());
+
+    pProg->addDefine("PERFTEST_ASYNC_SWAP", "1");
+    timer.update();
+    std::shared_future<ref<const ProgramVersion>> request = pProg->requestActiveVersion();
+    timer.update();
+    double maxFrameTime = timer.delta();
+    const ProgramVersion* pOldVersion = pProg->getServedVersion().get();
+    uint32_t frameCount = 0;
+    while (pProg->getServedVersion().get() == pOldVersion)
+    {
+        // A frame using the last good version.
+        if (request.wait_for(std::chrono::milliseconds(16)) == std::future_status::ready && !request.get())
+            break;
+        timer.update();
+        maxFrameTime = std::max(maxFrameTime, timer.delta());
+        frameCount++;
+    }
+    const bool swapped = pProg->getServedVersion().get() == request.get().get();
+    printf("Version change (async): %u frames served by the last good version, longest frame %.3fs, %.3fs from request to swap%s\n",
+        frameCount, maxFrameTime, pProg->getLastSwapTime(), swapped ? "" : " (failed)");
+    return swapped;
+}
+
+/**
+ * Create the kernels of the path tracer and SVGF programs and generate their code, once with
+ * full kernels and once with kernels that only carry code, and report the time per kernel.
+ */
+void CodeOnlyBenchmark(ref<Device>& device)
+{
+    ProgramManager* pProgramManager = device->getProgramManager();
+    const bool codeOnlyMode = pProgramManager->isKernelCodeOnlyMode();
+    const size_t sessionPoolSize = pProgramManager->getSessionPoolSize();
+    pProgramManager->setSessionPoolSize(0);
+
+    double kernelTimes[2] = {};
+    double codegenTimes[2] = {};
+    size_t kernelCount = 0;
+    const char* names[2] = {"full", "code only"};
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        pProgramManager->setKernelCodeOnlyMode(i == 1);
+
+        ref<Program> programs[] = {CreatePathTracerProgram(device), CreateSVGFProgram(device, ProgramLinkingStyle::Default)};
+        kernelCount = 0;
+        for (auto& pProg : programs)
+        {
+            ref<const ProgramVersion> pVersion = pProg->getActiveVersion();
+
+            CpuTimer timer;
+            timer.update();
+            ref<const ProgramKernels> pKernels = pVersion->getKernels(pProg->getTypeConformances());
+            timer.update();
+            kernelTimes[i] += timer.delta();
+
+            for (const auto& pGroup : pKernels->getUniqueEntryPointGroups())
+            {
+                for (size_t k = 0; k < pGroup->getKernelCount(); k++)
+                {
+                    pGroup->getKernelByIndex(k)->getBlobData();
+                    kernelCount++;
+                }
+            }
+            timer.update();
+            codegenTimes[i] += timer.delta();
+        }
+
+        printf("Kernels (%s): %zu kernels, creation %.2fms per kernel, codegen %.2fms per kernel\n", names[i], kernelCount,
+            1000.0 * kernelTimes[i] / kernelCount, 1000.0 * codegenTimes[i] / kernelCount);
+    }
+    double saved = (kernelTimes[0] + codegenTimes[0] - kernelTimes[1] - codegenTimes[1]) / kernelCount;
+    printf("Kernels: code-only mode saves %.2fms per kernel\n", 1000.0 * saved);
+
+    pProgramManager->setKernelCodeOnlyMode(codeOnlyMode);
+    pProgramManager->setSessionPoolSize(sessionPoolSize);
+}
+
+/**
+ * Compile the path tracer for two targets, SPIR-V through glslang and SPIR-V generated
+ * directly, and report the code generation time of each target. Unlike the test case, which
+ * reloads the program to switch the backend, the front-end only runs once.
+ */
+void MultiTargetBenchmark(ref<Device>& device)
+{
+    ProgramManager* pProgramManager = device->getProgramManager();
+    const bool spirvDirect = pProgramManager->isSpirvDirectMode();
+    ProgramManager::AdditionalTarget target;
+    target.format = SLANG_SPIRV;
+    target.spirvDirect = !spirvDirect;
+    pProgramManager->setAdditionalTargets({target});
+
+    CpuTimer timer;
+    timer.update();
+    ref<Program> pProg = CreatePathTracerProgram(device);
+    ref<const ProgramVersion> pVersion = pProg->getActiveVersion();
+    ref<const ProgramKernels> pKernels = pVersion->getKernels(pProg->getTypeConformances());
+    timer.update();
+    printf("Multi-target: front end %.3fs for both targets%s\n", timer.delta(), pVersion->isCacheBacked() ? " (created from the shader cache)" : "");
+
+    const char* names[2] = {spirvDirect ? "SPIR-V direct" : "glslang", spirvDirect ? "glslang" : "SPIR-V direct"};
+    const EntryPointKernel* pKernel = pKernels->getKernel(ShaderType::Compute);
+    for (uint32_t i = 0; i < pKernel->getTargetCount(); i++)
+    {
+        timer.update();
+        EntryPointKernel::BlobData blob = pKernel->getTargetBlobData(i);
+        timer.update();
+        printf("Multi-target: target %u (%s): codegen %.3fs, %zu bytes\n", i, names[i], timer.delta(), blob.size);
+    }
+
+    pProgramManager->setAdditionalTargets({});
+}
+
+/**
+ * Measure the compression ratio and the encode and decode throughput of SPIR-V compression
+ * on the path tracer kernel.
+ */
+void SpirvCompressionBenchmark(ref<Device>& device)
+{
+    const uint32_t kIterations = 100;
+    ref<Program> pProg = CreatePathTracerProgram(device);
+    ref<const ProgramKernels> pKernels = pProg->getActiveVersion()->getKernels(pProg->getTypeConformances());
+    EntryPointKernel::BlobData blob = pKernels->getKernel(ShaderType::Compute)->getBlobData();
+    if (!isSpirv(blob.data, blob.size))
+    {
+        printf("SPIR-V benchmark: kernel code is not SPIR-V\n");
+        return;
+    }
+
+    CpuTimer timer;
+    std::vector<uint8_t> compressed;
+    timer.update();
+    for (uint32_t i = 0; i < kIterations; i++)
+        compressSpirv(blob.data, blob.size, compressed);
+    timer.update();
+    double encodeTime = timer.delta();
+
+    std::vector<uint8_t> decompressed;
+    for (uint32_t i = 0; i < kIterations; i++)
+        decompressSpirv(compressed.data(), compressed.size(), decompressed);
+    timer.update();
+    double decodeTime = timer.delta();
+
+    ASSERT(decompressed.size() == blob.size && std::memcmp(decompressed.data(), blob.data, blob.size) == 0);
+    double megabytes = double(blob.size) * kIterations / (1024.0 * 1024.0);
+    printf("SPIR-V benchmark: %.2f KB -> %.2f KB (ratio %.2f), encode %.0f MB/s, decode %.0f MB/s\n", blob.size / 1024.0,
+        compressed.size() / 1024.0, double(blob.size) / double(compressed.size()), megabytes / encodeTime, megabytes / decodeTime);
+}
+
+/**
+ * Measure the creation time of the Slang global session with the core module compiled from
+ * source and loaded from the snapshot.
+ */
+void StartupBenchmark(const std::filesystem::path& snapshotPath)
+{
+    const uint32_t kIterations = 3;
+    CpuTimer timer;
+
+    timer.update();
+    for (uint32_t i = 0; i < kIterations; i++)
+    {
+        Slang::ComPtr<slang::IGlobalSession> pGlobalSession;
+        slang::createGlobalSession(pGlobalSession.writeRef());
+    }
+    timer.update();
+    printf("Startup (core module compiled): %.3fs per global session\n", timer.delta() / kIterations);
+
+    if (snapshotPath.empty())
+    {
+        printf("Startup (core module snapshot): disabled\n");
+        return;
+    }
+    timer.update();
+    for (uint32_t i = 0; i < kIterations; i++)
+    {
+        if (!createGlobalSessionFromSnapshot(snapshotPath))
+        {
+            printf("Startup (core module snapshot): snapshot %s not available\n", snapshotPath.string().c_str());
+            return;
+        }
+    }
+    timer.update();
+    printf("Startup (core module snapshot): %.3fs per global session\n", timer.delta() / kIterations);
+}
+
+/**
+ * Load and store entries in a shader cache, validating every entry loaded. Entries are
+ * generated under the entry lock, as kernels are. Run several processes on the same
+ * directory to check that processes sharing a cache never see corrupt entries.
+ * @return True if all entries loaded were valid.
+ */
+bool CacheStress(const std::filesystem::path& directory, uint32_t iterations)
+{
+    const uint32_t kKeyCount = 64;
+    auto makePayload = [](uint32_t index)
+    {
+        std::vector<uint8_t> data(1024 + (index * 7919) % 65536);
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] = uint8_t((i * 31 + index) ^ (i >> 8));
+        return data;
+    };
+
+    ShaderCache cache(directory / "stress");
+    std::mt19937 rng{std::random_device{}()};
+    size_t generated = 0;
+    size_t waited = 0;
+    size_t mismatches = 0;
+
+    CpuTimer timer;
+    timer.update();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        uint32_t index = rng() % kKeyCount;
+        Hash128 key = hash128(&index, sizeof(index));
+        std::vector<uint8_t> expected = makePayload(index);
+
+        std::vector<uint8_t> data;
+        if (cache.load(key, data))
+        {
+            if (data != expected)
+                mismatches++;
+            // Occasionally replace the entry to exercise readers racing with writers.
+            if (rng() % 16 != 0)
+                continue;
+        }
+
+        ShaderCache::EntryLock lock = cache.lockEntry(key);
+        if (lock.hasWaited())
+            waited++;
+        cache.store(key, expected.data(), expected.size());
+        generated++;
+    }
+    timer.update();
+
+    const ShaderCache::Stats stats = cache.getStats();
+    printf("Cache stress: %u iterations in %.3fs, %zu hits, %zu stores (%zu after waiting for a lock), %zu corrupt, %zu mismatching\n",
+        iterations, timer.delta(), stats.hitCount, generated, waited, stats.corruptCount, mismatches);
+    return stats.corruptCount == 0 && mismatches == 0;
+}
+
+void PrintCacheStats(ref<Device>& device)
+{
+    const ProgramManager::CompilationStats stats = device->getProgramManager()->getCompilationStats();
+    if (ShaderCache* pShaderCache = device->getProgramManager()->getShaderCache())
+    {
+        printf("Shader cache: %zu/%zu program versions created from cache, kernel code hits: %zu, misses: %zu\n",
+            stats.programVersionCacheHits, stats.programVersionCount, stats.kernelCacheHits, stats.kernelCacheMisses);
+        const CodeBlobStore::Stats blobStats = device->getProgramManager()->getCodeBlobStore().getStats();
+        printf("Shared shader cache: %zu corrupt entries ignored, %zu kernels waited for another process\n",
+            pShaderCache->getStats().corruptCount, blobStats.diskLockWaits);
+        if (blobStats.diskBlobStoredBytes > 0)
+            printf("Kernel code written: %.2f MB, %.2f MB compressed\n", blobStats.diskBlobBytes / (1024.0 * 1024.0),
+                blobStats.diskBlobStoredBytes / (1024.0 * 1024.0));
+    }
+    if (device->getProgramManager()->getModuleCache())
+        printf("Module cache: %zu modules loaded from cache, %zu modules stored\n", stats.slangModulesLoaded, stats.slangModulesStored);
+    printf("Session pool: %zu hits, %zu misses, %zu evictions\n", stats.sessionPoolHits, stats.sessionPoolMisses, stats.sessionPoolEvictions);
+    printf("Type conformances: %zu composites reused, %zu created\n", stats.typeConformanceCacheHits, stats.typeConformanceCacheMisses);
+    for (size_t i = 0; i < stats.targetCodegen.size(); i++)
+        printf("Code generation (target %zu): %zu kernels in %.3fs, %.2f MB\n", i, stats.targetCodegen[i].kernelCount,
+            stats.targetCodegen[i].time, stats.targetCodegen[i].bytes / (1024.0 * 1024.0));
+    if (stats.versionSwaps > 0)
+        printf("Version swaps: %zu, %.3fs average and %.3fs max from request to swap\n", stats.versionSwaps,
+            stats.versionSwapTotalTime / stats.versionSwaps, stats.versionSwapMaxTime);
+    if (device->getProgramManager()->getPermutationManifest())
+        printf("Permutation manifest: %zu permutations precompiled, %zu used\n", stats.permutationsPrecompiled, stats.precompiledVersionsUsed);
+    printf("Program versions: %zu resident (%.2f MB), %zu evicted (%.2f MB), %zu kernel specializations evicted\n",
+        stats.residentProgramVersions, stats.residentProgramVersionBytes / (1024.0 * 1024.0), stats.programVersionsEvicted,
+        stats.programVersionBytesEvicted / (1024.0 * 1024.0), stats.kernelSpecializationsEvicted);
+
+    const PipelineCreationAPIDispatcher::PipelineCacheStats pipelineStats = device->getPipelineCacheStats();
+    printf("Pipeline cache%s: %zu hits (%.3fs), %zu misses (%.3fs)\n", pipelineStats.loadedFromDisk ? " (loaded from disk)" : "",
+        pipelineStats.hitCount, pipelineStats.hitTime, pipelineStats.missCount, pipelineStats.missTime);
+
+    const Device::ShaderCacheStats shaderCacheStats = device->getShaderCacheStats();
+    printf("gfx shader cache: %zu hits, %zu misses, %zu entries, %.2f MB on disk, %zu files (%.2f MB) evicted\n",
+        shaderCacheStats.hitCount, shaderCacheStats.missCount, shaderCacheStats.entryCount, shaderCacheStats.sizeInBytes / (1024.0 * 1024.0),
+        shaderCacheStats.evictedEntries, shaderCacheStats.evictedBytes / (1024.0 * 1024.0));
+
+    const TaskScheduler::Stats taskStats = device->getTaskScheduler()->getStats();
+    printf("Task scheduler: %u workers, %zu tasks, %zu stolen\n", device->getTaskScheduler()->getWorkerCount(), taskStats.taskCount,
+        taskStats.stealCount);
+    for (const auto& [name, stats] : taskStats.tasks)
+        printf("  %s: %zu tasks, %.3fs running (max %.3fs), %.3fs queued\n", name.c_str(), stats.count, stats.totalRunTime, stats.maxRunTime,
+            stats.totalQueueTime);
 }
 
 int main(int argc, char* argv[])
 {
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+        return 1;
+
+    if (options.cacheStressIterations > 0)
+    {
+        if (options.shaderCacheDirectory.empty())
+        {
+            printf("--cache-stress requires --shader-cache\n");
+            return 1;
+        }
+        return CacheStress(options.shaderCacheDirectory, options.cacheStressIterations) ? 0 : 1;
+    }
+
+    if (options.startupBenchmark)
+        StartupBenchmark(options.coreModuleSnapshotPath);
+
     printf("Starting creating device\n");
-    ref<Device> device = make_ref<Device>();
+    Device::Desc deviceDesc;
+    deviceDesc.coreModuleSnapshotPath = options.coreModuleSnapshotPath;
+    deviceDesc.pipelineCachePath = options.pipelineCachePath;
+    deviceDesc.shaderCachePath = options.gfxShaderCacheDirectory;
+    deviceDesc.shaderCacheMaxBytes = options.gfxShaderCacheMaxBytes;
+    deviceDesc.taskWorkerCount = options.taskWorkerCount;
+    ref<Device> device = make_ref<Device>(deviceDesc);
+    printf("Slang global session created in %.3fs (%s)\n", device->getSlangStartupTime(),
+        device->isCoreModuleSnapshotLoaded() ? "core module loaded from snapshot" : "core module compiled");
+
+    if (!options.shaderCacheDirectory.empty())
+    {
+        ProgramManager::ShaderCacheDesc shaderCacheDesc;
+        shaderCacheDesc.directory = options.shaderCacheDirectory;
+        shaderCacheDesc.skipFrontEndOnHit = true;
+        device->getProgramManager()->setShaderCache(shaderCacheDesc);
+    }
+    if (!options.moduleCacheDirectory.empty())
+        device->getProgramManager()->setModuleCache(options.moduleCacheDirectory);
+    if (!options.permutationManifestPath.empty())
+        device->getProgramManager()->setPermutationManifest(options.permutationManifestPath);
+    if (options.programVersionBudget > 0)
+        device->getProgramManager()->setProgramVersionBudget(options.programVersionBudget);
+
+    if (options.compareFrontEnds)
+        CompareFrontEnds(device);
+    if (options.linkingBenchmark)
+        LinkingBenchmark(device);
+    if (options.codeOnlyBenchmark)
+        CodeOnlyBenchmark(device);
+    if (options.multiTarget)
+        MultiTargetBenchmark(device);
+    if (options.stressThreadCount > 0 && !ConcurrencyStress(device, options.stressThreadCount))
+        return 1;
+    if (options.batchCompile && !BatchCompileBenchmark(device))
+        return 1;
+    if (options.codegenBenchmark && !EagerCodegenBenchmark(device))
+        return 1;
+    if (options.asyncSwap && !AsyncSwapBenchmark(device))
+        return 1;
+
     TestCase(device);
+    if (options.permutationSweepCount > 0)
+        PermutationSweep(device, options.permutationSweepCount);
+    if (options.spirvBenchmark)
+        SpirvCompressionBenchmark(device);
+
+    PrintCacheStats(device);
 
     return 0;
 }